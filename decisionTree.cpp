@@ -1,17 +1,28 @@
 /*
  Description : A C++ implementation of a decision tree classifier based on the
-               ID3 (Iterative Dichotomiser 3) algorithm.
+               ID3 (Iterative Dichotomiser 3) algorithm, extended with
+               threshold splits on numeric columns.
                The program reads a dataset from a CSV file,
                builds a predictive model by recursively splitting the data
                based on information gain, and then allows for interactive
-               predictions on new, unseen data instances.
+               predictions on new, unseen data instances. It can also
+               grow a random forest of such trees, or gradient boosted
+               trees for a two-class target.
 
  Expected File Format:
  -   Header Row: The first line of the file is the header row,
      containing the names of the features and the target variable.
- -   Delimiter: Values must be separated by commas (,).
- -   Data Type: All data is treated as categorical (string) data.
- -   No Missing Values: The program does not handle missing values.
+ -   Delimiter: Values must be separated by commas (,). Fields that contain
+     commas, double quotes or line breaks must be enclosed in double quotes,
+     with embedded quotes doubled ("") as described in RFC 4180.
+ -   Data Type: A column whose non-empty values all parse as numbers is
+     numeric and is split with binary "<= threshold" tests chosen from the
+     rows in sorted order (C4.5/CART style). Every other column, and the
+     target, is treated as categorical (string) data.
+ -   Missing Values: An empty cell is missing, in numeric and categorical
+     columns alike. It never gets a branch of its own: every split learns
+     which of its branches the missing rows join best, and prediction sends
+     a missing or absent feature down that branch.
 
  Interactive Prediction Format:
  When prompted, enter feature-value pairs separated by commas, like so:
@@ -23,430 +34,4958 @@
 #include <sstream>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <map>
-#include <set>
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <memory>
+#include <cstring>
+#include <cstdlib>
+#include <iterator>
+#include <charconv>
+#include <limits>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <thread>
 
-struct TreeNode
-{
-    std::string feature;
-    std::string value;
-    std::string prediction;
-    bool isLeaf;
-    std::vector<std::unique_ptr<TreeNode>> children;
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define DT_HAVE_MMAP 1
+#endif
 
-    TreeNode() : isLeaf(false) {}
-};
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define DT_HAVE_AVX2 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define DT_HAVE_SSE2 1
+#endif
 
-class DecisionTree
+// Index of the lowest set bit of a non-zero word
+inline int countTrailingZeros(uint64_t bits)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(bits);
+#else
+    int count = 0;
+    while ((bits & 1) == 0)
+    {
+        bits >>= 1;
+        count++;
+    }
+    return count;
+#endif
+}
+
+// Read-only whole-file buffer backed by a memory mapping where the platform
+// supports it
+class MappedFile
 {
 private:
-    std::vector<std::vector<std::string>> data;
-    std::vector<std::string> headers;
-    std::string targetColumn;
-    std::unique_ptr<TreeNode> root;
+    const char *base;
+    size_t length;
+    bool mapped;
+    std::vector<char> buffer;
+
+public:
+    MappedFile() : base(nullptr), length(0), mapped(false) {}
+    ~MappedFile() { close(); }
 
-    // Parse CSV file
-    bool loadCSV(const std::string &filename)
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool open(const std::string &filename)
     {
-        std::ifstream file(filename);
-        if (!file.is_open())
+        close();
+#ifdef DT_HAVE_MMAP
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        struct stat info;
+        if (fstat(fd, &info) != 0)
         {
-            std::cerr << "Error: Cannot open file " << filename << std::endl;
+            ::close(fd);
             return false;
         }
 
-        std::string line;
-        bool isFirstLine = true;
-
-        while (std::getline(file, line))
+        length = static_cast<size_t>(info.st_size);
+        if (length > 0)
         {
-            std::vector<std::string> row;
-            std::stringstream ss(line);
-            std::string cell;
-
-            while (std::getline(ss, cell, ','))
-            {
-                // Remove whitespace
-                cell.erase(0, cell.find_first_not_of(" \t"));
-                cell.erase(cell.find_last_not_of(" \t") + 1);
-                row.push_back(cell);
-            }
-
-            if (isFirstLine)
-            {
-                headers = row;
-                isFirstLine = false;
-            }
-            else
+            void *addr = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr == MAP_FAILED)
             {
-                data.push_back(row);
+                ::close(fd);
+                length = 0;
+                return false;
             }
+            madvise(addr, length, MADV_SEQUENTIAL);
+            base = static_cast<const char *>(addr);
+            mapped = true;
         }
 
-        file.close();
+        ::close(fd);
+        return true;
+#else
+        std::ifstream file(filename, std::ios::binary);
+        if (!file.is_open())
+            return false;
+
+        buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        base = buffer.data();
+        length = buffer.size();
         return true;
+#endif
     }
 
-    // Calculate entropy
-    double calculateEntropy(const std::vector<int> &indices)
+    void close()
     {
-        if (indices.empty())
-            return 0.0;
+#ifdef DT_HAVE_MMAP
+        if (mapped)
+            munmap(const_cast<char *>(base), length);
+#endif
+        buffer.clear();
+        base = nullptr;
+        length = 0;
+        mapped = false;
+    }
 
-        std::map<std::string, int> counts;
-        int targetIdx = getColumnIndex(targetColumn);
+    const char *data() const { return base; }
+    size_t size() const { return length; }
+};
 
-        for (int idx : indices)
-        {
-            counts[data[idx][targetIdx]]++;
-        }
+// RFC 4180 CSV reader. Fields are returned as views into the mapped file,
+// which is never written to, so several readers can work through different
+// ranges of one file at once. Only a field with escaped quotes has to be
+// copied; its view stays valid until the next row is read. Reading a row
+// allocates nothing once the buffers have grown to the row's size.
+class CsvReader
+{
+private:
+    MappedFile file;
+    const char *cursor;
+    const char *limit;
+    std::deque<std::string> unescaped; // unescaped fields of the current row
+    size_t unescapedUsed;
+
+    // Classified bytes [window, window + 64): one bit per byte that ends a
+    // field (comma, CR or LF) and one per quote. Bits past limit stay clear.
+    const char *window;
+    uint64_t windowEnds;
+    uint64_t windowQuotes;
 
-        double entropy = 0.0;
-        int total = indices.size();
+    static bool isFieldEnd(char c)
+    {
+        return c == ',' || c == '\n' || c == '\r';
+    }
+
+    void loadWindow(const char *base)
+    {
+        window = base;
+        windowEnds = 0;
+        windowQuotes = 0;
+        size_t available = limit - base;
 
-        for (const auto &pair : counts)
+#if defined(DT_HAVE_AVX2)
+        if (available >= 64)
         {
-            double prob = static_cast<double>(pair.second) / total;
-            if (prob > 0)
+            const __m256i comma = _mm256_set1_epi8(',');
+            const __m256i lf = _mm256_set1_epi8('\n');
+            const __m256i cr = _mm256_set1_epi8('\r');
+            const __m256i quote = _mm256_set1_epi8('"');
+            for (int i = 0; i < 64; i += 32)
             {
-                entropy -= prob * log2(prob);
+                __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(base + i));
+                __m256i ends = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(bytes, comma), _mm256_cmpeq_epi8(bytes, lf)),
+                                               _mm256_cmpeq_epi8(bytes, cr));
+                windowEnds |= uint64_t(uint32_t(_mm256_movemask_epi8(ends))) << i;
+                windowQuotes |= uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, quote)))) << i;
             }
+            return;
+        }
+#elif defined(DT_HAVE_SSE2)
+        if (available >= 64)
+        {
+            const __m128i comma = _mm_set1_epi8(',');
+            const __m128i lf = _mm_set1_epi8('\n');
+            const __m128i cr = _mm_set1_epi8('\r');
+            const __m128i quote = _mm_set1_epi8('"');
+            for (int i = 0; i < 64; i += 16)
+            {
+                __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(base + i));
+                __m128i ends = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(bytes, comma), _mm_cmpeq_epi8(bytes, lf)),
+                                            _mm_cmpeq_epi8(bytes, cr));
+                windowEnds |= uint64_t(uint32_t(_mm_movemask_epi8(ends))) << i;
+                windowQuotes |= uint64_t(uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, quote)))) << i;
+            }
+            return;
         }
+#endif
 
-        return entropy;
+        for (size_t i = 0; i < std::min<size_t>(available, 64); i++)
+        {
+            windowEnds |= uint64_t(isFieldEnd(base[i])) << i;
+            windowQuotes |= uint64_t(base[i] == '"') << i;
+        }
     }
 
-    // Calculate information gain
-    double calculateInformationGain(const std::vector<int> &indices, const std::string &feature)
+    // First byte at or after p whose bit is set in the windows' mask, or limit
+    const char *findInWindows(const char *p, uint64_t CsvReader::*mask)
     {
-        double parentEntropy = calculateEntropy(indices);
-        int featureIdx = getColumnIndex(feature);
-
-        // Group by feature values
-        std::map<std::string, std::vector<int>> groups;
-        for (int idx : indices)
+        while (p < limit)
         {
-            groups[data[idx][featureIdx]].push_back(idx);
-        }
-
-        double weightedEntropy = 0.0;
-        int total = indices.size();
+            size_t offset = p - window;
+            if (offset >= 64)
+            {
+                loadWindow(p);
+                offset = 0;
+            }
 
-        for (const auto &group : groups)
-        {
-            double weight = static_cast<double>(group.second.size()) / total;
-            weightedEntropy += weight * calculateEntropy(group.second);
+            uint64_t bits = (this->*mask) >> offset;
+            if (bits != 0)
+                return p + countTrailingZeros(bits);
+            p = window + std::min<size_t>(64, limit - window);
         }
+        return limit;
+    }
 
-        return parentEntropy - weightedEntropy;
+    // First comma, CR or LF at or after p, or limit
+    const char *findFieldEnd(const char *p)
+    {
+#if defined(DT_HAVE_SSE2)
+        return findInWindows(p, &CsvReader::windowEnds);
+#else
+        while (p < limit && !isFieldEnd(*p))
+            p++;
+        return p;
+#endif
     }
 
-    // Get column index by name
-    int getColumnIndex(const std::string &columnName)
+    // First quote at or after p, or limit
+    const char *findQuote(const char *p)
     {
-        auto it = std::find(headers.begin(), headers.end(), columnName);
-        return it != headers.end() ? std::distance(headers.begin(), it) : -1;
+#if defined(DT_HAVE_SSE2)
+        return findInWindows(p, &CsvReader::windowQuotes);
+#else
+        while (p < limit && *p != '"')
+            p++;
+        return p;
+#endif
     }
 
-    // Find best feature to split on
-    std::string findBestFeature(const std::vector<int> &indices, const std::set<std::string> &usedFeatures)
+    // Parse one field and leave the cursor on the character that ended it
+    std::string_view readField()
     {
-        std::string bestFeature;
-        double bestGain = -1.0;
+        const char *p = cursor;
+        while (p < limit && (*p == ' ' || *p == '\t'))
+            p++;
 
-        for (const std::string &feature : headers)
+        if (p < limit && *p == '"')
         {
-            if (feature != targetColumn && usedFeatures.find(feature) == usedFeatures.end())
+            const char *start = ++p;
+            std::string *copy = nullptr;
+
+            // A doubled quote is an escaped quote; once one is seen the field
+            // is collected without the dropped characters in a buffer.
+            while (true)
             {
-                double gain = calculateInformationGain(indices, feature);
-                if (gain > bestGain)
+                const char *quote = findQuote(p);
+                if (copy)
+                    copy->append(p, quote);
+                p = quote;
+                if (p + 1 >= limit || p[1] != '"')
+                    break;
+
+                if (!copy)
                 {
-                    bestGain = gain;
-                    bestFeature = feature;
+                    if (unescapedUsed == unescaped.size())
+                        unescaped.emplace_back();
+                    copy = &unescaped[unescapedUsed++];
+                    copy->assign(start, p);
                 }
+                *copy += '"';
+                p += 2;
             }
-        }
 
-        return bestFeature;
-    }
+            const char *end = p;
+            if (p < limit)
+                p++;
 
-    // Get most common class
-    std::string getMostCommonClass(const std::vector<int> &indices)
-    {
-        std::map<std::string, int> counts;
-        int targetIdx = getColumnIndex(targetColumn);
+            // Ignore anything between the closing quote and the delimiter
+            p = findFieldEnd(p);
 
-        for (int idx : indices)
-        {
-            counts[data[idx][targetIdx]]++;
+            cursor = p;
+            return copy ? std::string_view(*copy) : std::string_view(start, end - start);
         }
 
-        std::string mostCommon;
-        int maxCount = 0;
-        for (const auto &pair : counts)
-        {
-            if (pair.second > maxCount)
-            {
-                maxCount = pair.second;
-                mostCommon = pair.first;
-            }
-        }
+        const char *start = p;
+        p = findFieldEnd(p);
 
-        return mostCommon;
+        const char *end = p;
+        while (end > start && (end[-1] == ' ' || end[-1] == '\t'))
+            end--;
+
+        cursor = p;
+        return std::string_view(start, end - start);
     }
 
-    // Check if all instances have same class
-    bool allSameClass(const std::vector<int> &indices)
+    // Move the cursor to the end of the current field without decoding it
+    void skipField()
     {
-        if (indices.empty())
-            return true;
+        const char *p = cursor;
+        while (p < limit && (*p == ' ' || *p == '\t'))
+            p++;
 
-        int targetIdx = getColumnIndex(targetColumn);
-        std::string firstClass = data[indices[0]][targetIdx];
-
-        for (int idx : indices)
+        if (p < limit && *p == '"')
         {
-            if (data[idx][targetIdx] != firstClass)
+            p = findQuote(p + 1);
+            while (p + 1 < limit && p[1] == '"')
             {
-                return false;
+                p = findQuote(p + 2);
             }
+            if (p < limit)
+                p++;
         }
 
-        return true;
+        cursor = findFieldEnd(p);
     }
 
-    // Build decision tree recursively
-    std::unique_ptr<TreeNode> buildTree(const std::vector<int> &indices, std::set<std::string> usedFeatures)
+public:
+    CsvReader()
+        : cursor(nullptr), limit(nullptr), unescapedUsed(0), window(nullptr), windowEnds(0), windowQuotes(0) {}
+
+    bool open(const std::string &filename)
     {
-        auto node = std::make_unique<TreeNode>();
+        if (!file.open(filename))
+            return false;
 
-        // Base cases
-        if (indices.empty())
-        {
-            node->isLeaf = true;
-            node->prediction = "Unknown";
-            return node;
-        }
+        cursor = file.data();
+        limit = cursor + file.size();
 
-        if (allSameClass(indices))
-        {
-            node->isLeaf = true;
-            node->prediction = data[indices[0]][getColumnIndex(targetColumn)];
-            return node;
-        }
+        // Skip a UTF-8 byte order mark
+        if (limit - cursor >= 3 && std::memcmp(cursor, "\xEF\xBB\xBF", 3) == 0)
+            cursor += 3;
 
-        // Find best feature
-        std::string bestFeature = findBestFeature(indices, usedFeatures);
-        if (bestFeature.empty())
-        {
-            node->isLeaf = true;
-            node->prediction = getMostCommonClass(indices);
-            return node;
-        }
+        loadWindow(cursor);
+        return true;
+    }
 
-        node->feature = bestFeature;
-        usedFeatures.insert(bestFeature);
-        int featureIdx = getColumnIndex(bestFeature);
+    // Read records from [begin, end) of a buffer owned by someone else
+    void attach(const char *begin, const char *end)
+    {
+        file.close();
+        cursor = begin;
+        limit = end;
+        loadWindow(cursor);
+    }
 
-        // Group by feature values
-        std::map<std::string, std::vector<int>> groups;
-        for (int idx : indices)
-        {
-            groups[data[idx][featureIdx]].push_back(idx);
-        }
+    const char *position() const { return cursor; }
+    const char *bufferEnd() const { return limit; }
 
-        // Create children
-        for (const auto &group : groups)
-        {
-            auto child = buildTree(group.second, usedFeatures);
-            child->value = group.first;
-            node->children.push_back(std::move(child));
-        }
+    void skipBlankLines()
+    {
+        while (cursor < limit && (*cursor == '\n' || *cursor == '\r'))
+            cursor++;
+    }
 
-        return node;
+    // Read the next record into fields; returns false at end of file
+    bool readRow(std::vector<std::string_view> &fields)
+    {
+        size_t width;
+        return readRow(fields, std::vector<char>(), width);
     }
 
-    // Print tree recursively
-    void printTree(const TreeNode *node, int depth = 0, const std::string &parentValue = "")
+    // Read the next record, keeping only the fields whose flag in keep is
+    // set, or every field if keep is empty. The other fields are stepped
+    // over without being trimmed, unescaped or stored. width receives the
+    // record's total number of fields.
+    bool readRow(std::vector<std::string_view> &fields, const std::vector<char> &keep, size_t &width)
     {
-        if (!node)
-            return;
+        fields.clear();
+        unescapedUsed = 0;
+        width = 0;
 
-        std::string indent(depth * 2, ' ');
+        skipBlankLines();
+        if (cursor >= limit)
+            return false;
 
-        if (node->isLeaf)
-        {
-            std::cout << indent << "-> " << node->prediction << std::endl;
-        }
-        else
+        while (true)
         {
-            if (depth > 0)
-            {
-                std::cout << indent << "if " << node->feature << " == " << parentValue << ":" << std::endl;
-            }
+            if (keep.empty() || (width < keep.size() && keep[width]))
+                fields.push_back(readField());
             else
-            {
-                std::cout << "Root: " << node->feature << std::endl;
-            }
+                skipField();
+            width++;
 
-            for (const auto &child : node->children)
+            if (cursor < limit && *cursor == ',')
             {
-                if (!node->feature.empty())
-                {
-                    std::cout << indent << "  " << node->feature << " == " << child->value << ":" << std::endl;
-                }
-                printTree(child.get(), depth + 1, child->value);
+                cursor++;
+                continue;
             }
+
+            // End of record: \n, \r\n or end of file
+            if (cursor < limit && *cursor == '\r')
+                cursor++;
+            if (cursor < limit && *cursor == '\n')
+                cursor++;
+
+            return true;
         }
     }
+};
 
-    // Predict using the tree
-    std::string predict(const TreeNode *node, const std::map<std::string, std::string> &instance)
+// Checksum of a binary file's payload. Four independent lanes each take
+// every fourth word, so the multiplies of neighbouring words overlap.
+uint64_t checksum(const char *data, size_t size)
+{
+    const uint64_t prime = 1099511628211ULL;
+    uint64_t lanes[4] = {14695981039346656037ULL, 1, 2, 3};
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32)
     {
-        if (!node)
-            return "Unknown";
-
-        if (node->isLeaf)
+        for (int lane = 0; lane < 4; lane++)
         {
-            return node->prediction;
+            uint64_t word;
+            std::memcpy(&word, data + i + 8 * lane, 8);
+            lanes[lane] = (lanes[lane] ^ word) * prime;
+            lanes[lane] ^= lanes[lane] >> 29;
         }
+    }
 
-        auto it = instance.find(node->feature);
-        if (it == instance.end())
-        {
-            return "Unknown";
-        }
+    uint64_t h = lanes[0];
+    for (int lane = 1; lane < 4; lane++)
+    {
+        h = (h ^ lanes[lane]) * prime;
+    }
+    for (; i < size; i++)
+    {
+        h = (h ^ static_cast<unsigned char>(data[i])) * prime;
+    }
+    return h ^ size;
+}
 
-        std::string featureValue = it->second;
+// Builds the payload of a binary file. Every value and array is padded to a
+// multiple of 8 bytes, so arrays read back from an aligned mapping are
+// aligned for their element type and can be used in place.
+class BinaryWriter
+{
+private:
+    std::string bytes;
 
-        for (const auto &child : node->children)
-        {
-            if (child->value == featureValue)
-            {
-                return predict(child.get(), instance);
-            }
-        }
+public:
+    template <typename T>
+    void array(const T *values, size_t count)
+    {
+        bytes.append(reinterpret_cast<const char *>(values), count * sizeof(T));
+        bytes.append((8 - bytes.size() % 8) % 8, '\0');
+    }
 
-        return "Unknown";
+    template <typename T>
+    void put(const T &value) { array(&value, 1); }
+
+    template <typename T>
+    void putVector(const std::vector<T> &values)
+    {
+        put<uint64_t>(values.size());
+        array(values.data(), values.size());
     }
 
+    const std::string &data() const { return bytes; }
+};
+
+// Reads a BinaryWriter payload in place. Arrays are returned as pointers into
+// the buffer; nullptr means the payload ended early.
+class BinaryReader
+{
+private:
+    const char *cursor;
+    const char *limit;
+
 public:
-    bool train(const std::string &filename, const std::string &target)
+    BinaryReader() : cursor(nullptr), limit(nullptr) {}
+    BinaryReader(const char *data, size_t size) : cursor(data), limit(data + size) {}
+
+    template <typename T>
+    const T *array(size_t count)
     {
-        targetColumn = target;
+        size_t available = limit - cursor;
+        if (count > available / sizeof(T))
+            return nullptr;
 
-        if (!loadCSV(filename))
-        {
-            return false;
-        }
+        size_t bytes = count * sizeof(T);
+        size_t padded = std::min(available, bytes + (8 - bytes % 8) % 8);
+        const T *values = reinterpret_cast<const T *>(cursor);
+        cursor += padded;
+        return values;
+    }
 
-        if (data.empty())
-        {
-            std::cerr << "Error: No data loaded" << std::endl;
+    template <typename T>
+    bool get(T &value)
+    {
+        const T *stored = array<T>(1);
+        if (!stored)
             return false;
-        }
+        value = *stored;
+        return true;
+    }
 
-        if (getColumnIndex(targetColumn) == -1)
-        {
-            std::cerr << "Error: Target column '" << targetColumn << "' not found" << std::endl;
+    template <typename T>
+    bool getVector(std::vector<T> &values)
+    {
+        uint64_t count;
+        const T *stored;
+        if (!get(count) || !(stored = array<T>(count)))
             return false;
-        }
+        values.assign(stored, stored + count);
+        return true;
+    }
 
-        // Create indices for all data
-        std::vector<int> allIndices;
-        for (int i = 0; i < data.size(); i++)
-        {
-            allIndices.push_back(i);
-        }
+    template <typename T>
+    bool skipVector()
+    {
+        uint64_t count;
+        return get(count) && array<T>(count) != nullptr;
+    }
+
+    bool atEnd() const { return cursor == limit; }
+};
 
-        std::set<std::string> usedFeatures;
-        root = buildTree(allIndices, usedFeatures);
+// Fixed header of the binary files (saved models and dataset caches). The
+// payload after it is written by BinaryWriter in the byte order and record
+// layout of the machine that saved it; a reader with another layout rejects
+// the file rather than converting it.
+struct BinaryHeader
+{
+    char magic[8];        // file kind, zero terminated
+    uint32_t version;     // format version of that kind
+    uint32_t byteOrder;   // 0x01020304 as stored by the writer
+    uint32_t layout;      // size of the kind's fixed-size records, if any
+    uint32_t reserved;
+    uint64_t payloadSize; // bytes following the header
+    uint64_t checksum;    // checksum() of the payload
+};
 
-        return true;
+enum BinaryStatus
+{
+    binaryOk,
+    binaryMissing,      // cannot be opened
+    binaryForeign,      // not a file of the expected kind
+    binaryIncompatible, // another version, byte order or layout
+    binaryDamaged       // truncated or failing its checksum
+};
+
+// Write a header and payload. The file is written under a temporary name
+// and renamed into place, so readers never see half of it.
+bool writeBinaryFile(const std::string &filename, const char *magic, uint32_t version, uint32_t layout,
+                     const BinaryWriter &payload)
+{
+    BinaryHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, magic, std::min(std::strlen(magic), sizeof(header.magic) - 1));
+    header.version = version;
+    header.byteOrder = 0x01020304u;
+    header.layout = layout;
+    header.payloadSize = payload.data().size();
+    header.checksum = checksum(payload.data().data(), payload.data().size());
+
+    std::string staging = filename + ".tmp";
+    std::ofstream file(staging, std::ios::binary);
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(payload.data().data(), payload.data().size());
+    file.close();
+    if (!file || std::rename(staging.c_str(), filename.c_str()) != 0)
+    {
+        std::remove(staging.c_str());
+        return false;
     }
+    return true;
+}
+
+// Map a file written by writeBinaryFile and check its header and checksum.
+// On success payload reads the mapped payload, which lives as long as file.
+BinaryStatus mapBinaryFile(MappedFile &file, const std::string &filename, const char *magic, uint32_t version,
+                           uint32_t layout, BinaryReader &payload)
+{
+    if (!file.open(filename))
+        return binaryMissing;
+
+    BinaryHeader header;
+    char expected[sizeof(header.magic)] = {};
+    std::memcpy(expected, magic, std::min(std::strlen(magic), sizeof(expected) - 1));
+    if (file.size() < sizeof(header))
+        return binaryForeign;
+    std::memcpy(&header, file.data(), sizeof(header));
+
+    if (std::memcmp(header.magic, expected, sizeof(expected)) != 0)
+        return binaryForeign;
+    if (header.version != version || header.byteOrder != 0x01020304u || header.layout != layout)
+        return binaryIncompatible;
+
+    const char *data = file.data() + sizeof(header);
+    size_t size = file.size() - sizeof(header);
+    if (header.payloadSize != size || header.checksum != checksum(data, size))
+        return binaryDamaged;
+
+    payload = BinaryReader(data, size);
+    return binaryOk;
+}
 
-    void printDecisionTree()
+// Kind of a file written by writeBinaryFile, or "" if it is not one
+std::string binaryFileKind(const std::string &filename)
+{
+    BinaryHeader header;
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)))
+        return std::string();
+    return std::string(header.magic, std::find(header.magic, header.magic + sizeof(header.magic), '\0'));
+}
+
+// Dense integer code assigned to each distinct value of a column
+typedef uint32_t Code;
+
+// Interning table for the distinct values of one column. Values are stored
+// back to back in a single arena and looked up through an open-addressing
+// hash table, so encoding a cell allocates only when a new value appears.
+class Dictionary
+{
+private:
+    std::string arena;
+    std::vector<uint32_t> offsets; // value i is arena[offsets[i], offsets[i + 1])
+    std::vector<uint32_t> slots;   // code + 1 per slot, 0 marks an empty slot
+
+    static uint64_t hash(std::string_view text)
     {
-        if (root)
-        {
-            std::cout << "\nDecision Tree Structure:" << std::endl;
-            std::cout << "========================" << std::endl;
-            printTree(root.get());
-        }
-        else
+        uint64_t h = 14695981039346656037ULL;
+        for (char c : text)
         {
-            std::cout << "No tree built yet." << std::endl;
+            h ^= static_cast<unsigned char>(c);
+            h *= 1099511628211ULL;
         }
+        return h;
     }
 
-    std::string predictInstance(const std::map<std::string, std::string> &instance)
+    // Slot holding text, or the empty slot where it would be inserted
+    size_t probe(std::string_view text) const
     {
-        return predict(root.get(), instance);
+        size_t mask = slots.size() - 1;
+        size_t slot = hash(text) & mask;
+        while (slots[slot] != 0 && value(slots[slot] - 1) != text)
+        {
+            slot = (slot + 1) & mask;
+        }
+        return slot;
     }
 
-    void printDataInfo()
+    void grow()
     {
-        std::cout << "Dataset Information:" << std::endl;
-        std::cout << "===================" << std::endl;
-        std::cout << "Rows: " << data.size() << std::endl;
-        std::cout << "Columns: " << headers.size() << std::endl;
-        std::cout << "Features: ";
-        for (const std::string &header : headers)
+        slots.assign(slots.size() * 2, 0);
+        for (Code code = 0; code < size(); code++)
         {
-            std::cout << header << " ";
+            slots[probe(value(code))] = code + 1;
         }
-        std::cout << std::endl;
-        std::cout << "Target: " << targetColumn << std::endl
-                  << std::endl;
     }
-};
 
-int main()
-{
-    DecisionTree tree;
-    std::string filename, targetColumn;
+public:
+    static const Code npos = 0xFFFFFFFFu;
 
-    std::cout << "Decision Tree Builder" << std::endl;
-    std::cout << "====================" << std::endl;
+    Dictionary() : offsets(1, 0), slots(16, 0) {}
 
-    std::cout << "Enter CSV filename: ";
-    std::getline(std::cin, filename);
+    size_t size() const { return offsets.size() - 1; }
 
-    std::cout << "Enter target column name: ";
-    std::getline(std::cin, targetColumn);
+    std::string_view value(Code code) const
+    {
+        return std::string_view(arena.data() + offsets[code], offsets[code + 1] - offsets[code]);
+    }
 
-    if (tree.train(filename, targetColumn))
+    // Code of text, or npos if it has never been seen
+    Code find(std::string_view text) const
     {
-        tree.printDataInfo();
-        tree.printDecisionTree();
+        uint32_t entry = slots[probe(text)];
+        return entry != 0 ? entry - 1 : npos;
+    }
 
-        // Interactive prediction
-        std::cout << "\nInteractive Prediction Mode" << std::endl;
-        std::cout << "===========================" << std::endl;
-        std::cout << "Enter 'quit' to exit" << std::endl;
+    // Code of text, assigning the next free code on first sight
+    Code intern(std::string_view text)
+    {
+        size_t slot = probe(text);
+        if (slots[slot] != 0)
+            return slots[slot] - 1;
 
-        std::string input;
-        while (true)
-        {
-            std::cout << "\nEnter feature values (format: feature1=value1,feature2=value2): ";
-            std::getline(std::cin, input);
+        Code code = static_cast<Code>(size());
+        arena.append(text.data(), text.size());
+        offsets.push_back(static_cast<uint32_t>(arena.size()));
+        slots[slot] = code + 1;
 
-            if (input == "quit")
-                break;
+        if (2 * size() > slots.size())
+            grow();
 
-            std::map<std::string, std::string> instance;
-            std::stringstream ss(input);
-            std::string pair;
+        return code;
+    }
 
-            while (std::getline(ss, pair, ','))
-            {
-                size_t pos = pair.find('=');
-                if (pos != std::string::npos)
-                {
-                    std::string feature = pair.substr(0, pos);
+    // Store the values together with the lookup table, so read() only copies
+    void write(BinaryWriter &out) const
+    {
+        out.put<uint64_t>(arena.size());
+        out.put<uint64_t>(size());
+        out.put<uint64_t>(slots.size());
+        out.array(arena.data(), arena.size());
+        out.array(offsets.data(), offsets.size());
+        out.array(slots.data(), slots.size());
+    }
+
+    // Step over a dictionary stored by write()
+    static bool skip(BinaryReader &in)
+    {
+        uint64_t arenaSize, valueCount, slotCount;
+        return in.get(arenaSize) && in.get(valueCount) && in.get(slotCount) && in.array<char>(arenaSize) &&
+               in.array<uint32_t>(valueCount + 1) && in.array<uint32_t>(slotCount);
+    }
+
+    bool read(BinaryReader &in)
+    {
+        uint64_t arenaSize, valueCount, slotCount;
+        if (!in.get(arenaSize) || !in.get(valueCount) || !in.get(slotCount))
+            return false;
+
+        const char *text = in.array<char>(arenaSize);
+        const uint32_t *storedOffsets = in.array<uint32_t>(valueCount + 1);
+        const uint32_t *storedSlots = in.array<uint32_t>(slotCount);
+        if (!text || !storedOffsets || !storedSlots)
+            return false;
+
+        // The table must be a power of two with room to spare, and every
+        // value must lie inside the arena
+        if (slotCount < 16 || (slotCount & (slotCount - 1)) != 0 || 2 * valueCount > slotCount)
+            return false;
+        if (storedOffsets[0] != 0 || storedOffsets[valueCount] != arenaSize)
+            return false;
+        for (uint64_t i = 0; i < valueCount; i++)
+        {
+            if (storedOffsets[i] > storedOffsets[i + 1])
+                return false;
+        }
+        for (uint64_t i = 0; i < slotCount; i++)
+        {
+            if (storedSlots[i] > valueCount)
+                return false;
+        }
+
+        arena.assign(text, arenaSize);
+        offsets.assign(storedOffsets, storedOffsets + valueCount + 1);
+        slots.assign(storedSlots, storedSlots + slotCount);
+        return true;
+    }
+};
+
+// Parse a whole field as a finite number
+bool parseNumber(std::string_view text, double &value)
+{
+    const char *first = text.data();
+    const char *last = first + text.size();
+    if (first != last && *first == '+')
+        first++;
+    if (first == last)
+        return false;
+
+    std::from_chars_result result = std::from_chars(first, last, value);
+    return result.ec == std::errc() && result.ptr == last && std::isfinite(value);
+}
+
+// Quote a value for CSV output if it contains a delimiter, quote or newline
+std::string formatCsvField(std::string_view text)
+{
+    if (text.find_first_of(",\"\r\n") == std::string_view::npos)
+        return std::string(text);
+
+    std::string quoted = "\"";
+    for (char c : text)
+    {
+        if (c == '"')
+            quoted += '"';
+        quoted += c;
+    }
+    quoted += '"';
+    return quoted;
+}
+
+// Strict ordering of numeric cells with missing values (NaN) sorted last
+inline bool numberBefore(double a, double b)
+{
+    return !std::isnan(a) && (std::isnan(b) || a < b);
+}
+
+// Threshold halfway between two distinct values, unless rounding lands on
+// the upper one
+inline double splitPoint(double value, double next)
+{
+    double threshold = value + (next - value) / 2;
+    return threshold < next ? threshold : value;
+}
+
+// Work-stealing thread pool. Every worker owns a deque: it pushes and pops
+// its own tasks at the back, so recently split work stays hot in its cache,
+// and idle workers steal the oldest, largest tasks from the front of the
+// others. Threads outside the pool submit through a shared injection queue.
+class ThreadPool
+{
+private:
+    struct TaskQueue
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    // queues[0] is the injection queue, queues[i] belongs to worker i
+    std::vector<std::unique_ptr<TaskQueue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<size_t> queued;
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    bool stopping;
+
+    // Queue owned by the calling thread: its own for workers of this pool,
+    // the injection queue for everyone else
+    size_t ownQueue() const
+    {
+        const std::pair<const ThreadPool *, size_t> &self = currentWorker();
+        return self.first == this ? self.second : 0;
+    }
+
+    static std::pair<const ThreadPool *, size_t> &currentWorker()
+    {
+        thread_local std::pair<const ThreadPool *, size_t> self(nullptr, 0);
+        return self;
+    }
+
+    bool popBack(size_t index, std::function<void()> &task)
+    {
+        TaskQueue &queue = *queues[index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty())
+            return false;
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+        return true;
+    }
+
+    bool popFront(size_t index, std::function<void()> &task)
+    {
+        TaskQueue &queue = *queues[index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty())
+            return false;
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+        return true;
+    }
+
+    // Own work first, then the injection queue, then steal
+    bool findTask(std::function<void()> &task)
+    {
+        size_t self = ownQueue();
+        if (self != 0 && popBack(self, task))
+            return true;
+
+        for (size_t i = 0; i < queues.size(); i++)
+        {
+            size_t victim = (self + i) % queues.size();
+            if (victim != self || self == 0)
+            {
+                if (popFront(victim, task))
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    void workerLoop(size_t index)
+    {
+        currentWorker() = std::make_pair(this, index);
+        while (true)
+        {
+            std::function<void()> task;
+            if (findTask(task))
+            {
+                queued--;
+                task();
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wake.wait(lock, [this]
+            {
+                return stopping || queued > 0;
+            });
+            if (stopping && queued == 0)
+                return;
+        }
+    }
+
+public:
+    // threadCount counts the calling thread, so 1 means no workers at all
+    explicit ThreadPool(size_t threadCount) : queued(0), stopping(false)
+    {
+        size_t workerCount = threadCount > 1 ? threadCount - 1 : 0;
+        for (size_t i = 0; i <= workerCount; i++)
+        {
+            queues.push_back(std::make_unique<TaskQueue>());
+        }
+        for (size_t i = 1; i <= workerCount; i++)
+        {
+            workers.emplace_back([this, i]
+            {
+                workerLoop(i);
+            });
+        }
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread &worker : workers)
+        {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    size_t size() const { return workers.size() + 1; }
+
+    void submit(std::function<void()> task)
+    {
+        TaskQueue &queue = *queues[ownQueue()];
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.tasks.push_back(std::move(task));
+        }
+        queued++;
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+        }
+        wake.notify_one();
+    }
+
+    // Run one pending task on the calling thread, if there is any
+    bool runPending()
+    {
+        std::function<void()> task;
+        if (!findTask(task))
+            return false;
+        queued--;
+        task();
+        return true;
+    }
+
+    // Call fn(i) for every i in [0, count) across the pool and wait for all
+    template <typename Fn>
+    void parallelFor(size_t count, Fn fn);
+};
+
+// Tasks spawned on a pool that the spawning thread waits for. Waiting runs
+// other pool tasks instead of blocking, so groups nest without deadlock.
+class TaskGroup
+{
+private:
+    ThreadPool *pool;
+    std::atomic<size_t> pending;
+
+public:
+    explicit TaskGroup(ThreadPool *pool) : pool(pool), pending(0) {}
+    ~TaskGroup() { wait(); }
+
+    void run(std::function<void()> task)
+    {
+        pending++;
+        pool->submit([this, task]
+        {
+            task();
+            pending--;
+        });
+    }
+
+    void wait()
+    {
+        while (pending > 0)
+        {
+            if (!pool->runPending())
+                std::this_thread::yield();
+        }
+    }
+};
+
+template <typename Fn>
+void ThreadPool::parallelFor(size_t count, Fn fn)
+{
+    std::atomic<size_t> next(0);
+    auto work = [&]
+    {
+        for (size_t i = next++; i < count; i = next++)
+        {
+            fn(i);
+        }
+    };
+
+    TaskGroup helpers(this);
+    for (size_t i = 1; i < std::min(size(), count); i++)
+    {
+        helpers.run(work);
+    }
+    work();
+    helpers.wait();
+}
+
+// One column of the table. Categorical columns keep a contiguous code per
+// row; numeric columns keep the parsed values, NaN for empty cells, every
+// row index in ascending value order, and a quantized copy of the values.
+struct Column
+{
+    std::string name;
+    bool numeric;
+    Dictionary dictionary;
+    std::vector<Code> codes;
+    std::vector<double> numbers;
+    std::vector<int> sortedRows;
+
+    // Value bin b holds the values <= binEdges[b] that are above the previous
+    // edge; the last value bin is unbounded and the bin after it holds the
+    // missing values
+    std::vector<uint8_t> bins;
+    std::vector<double> binEdges;
+
+    Column() : numeric(false) {}
+
+    size_t binCount() const { return binEdges.size() + 2; }
+    uint8_t missingBin() const { return static_cast<uint8_t>(binEdges.size() + 1); }
+
+    // Code of the empty value, which marks a missing categorical cell, or
+    // Dictionary::npos when the column has no missing cells
+    Code missingCode() const { return dictionary.find(std::string_view()); }
+};
+
+// Columnar, dictionary-encoded table built once at load time. The text of the
+// CSV is only needed while encoding, so the mapping is released afterwards.
+// A column is numeric when all of its non-empty cells parse as numbers and at
+// least one does; every other column is categorical.
+class Dataset
+{
+private:
+    std::vector<Column> columns;
+    size_t rows;
+
+    // Bins per numeric column, including the one for missing values
+    static const size_t maxBins = 256;
+
+    static const uint32_t cacheVersion = 2;
+
+    // Store every column with its derived orders and bins. Numeric columns
+    // whose values all survive a round trip through float are stored as
+    // float, which halves the largest part of the cache.
+    void writeTable(BinaryWriter &out) const
+    {
+        std::vector<float> narrowed;
+        out.put<uint64_t>(rows);
+        out.put<uint64_t>(columns.size());
+        for (const Column &column : columns)
+        {
+            out.put<uint64_t>(column.name.size());
+            out.array(column.name.data(), column.name.size());
+            out.put<uint32_t>(column.numeric);
+            column.dictionary.write(out);
+            out.putVector(column.codes);
+
+            narrowed.assign(column.numbers.begin(), column.numbers.end());
+            bool single = true;
+            for (size_t i = 0; i < narrowed.size() && single; i++)
+            {
+                single = narrowed[i] == column.numbers[i] || std::isnan(column.numbers[i]);
+            }
+            out.put<uint32_t>(single);
+            if (single)
+                out.putVector(narrowed);
+            else
+                out.putVector(column.numbers);
+
+            out.putVector(column.sortedRows);
+            out.putVector(column.bins);
+            out.putVector(column.binEdges);
+        }
+    }
+
+    // Read a table stored by writeTable, checking every code, row index and
+    // bin against its column so that training cannot index out of range
+    bool readTable(BinaryReader &in, const std::vector<std::string> &selection)
+    {
+        uint64_t rowCount, columnCount;
+        if (!in.get(rowCount) || !in.get(columnCount) || rowCount > std::numeric_limits<int>::max())
+            return false;
+
+        columns.clear();
+        rows = rowCount;
+        std::vector<char> seen;
+        std::vector<float> narrowed;
+        for (uint64_t c = 0; c < columnCount; c++)
+        {
+            uint64_t nameSize;
+            uint32_t numeric, single;
+            const char *name;
+            if (!in.get(nameSize) || !(name = in.array<char>(nameSize)) || !in.get(numeric))
+                return false;
+
+            // Step over columns outside the selection without copying them
+            std::string_view columnName(name, nameSize);
+            if (!selection.empty() && std::find(selection.begin(), selection.end(), columnName) == selection.end())
+            {
+                if (!Dictionary::skip(in) || !in.skipVector<Code>() || !in.get(single) ||
+                    !(single ? in.skipVector<float>() : in.skipVector<double>()) || !in.skipVector<int>() ||
+                    !in.skipVector<uint8_t>() || !in.skipVector<double>())
+                    return false;
+                continue;
+            }
+
+            columns.emplace_back();
+            Column &column = columns.back();
+            if (!column.dictionary.read(in) || !in.getVector(column.codes) || !in.get(single))
+                return false;
+
+            if (single)
+            {
+                if (!in.getVector(narrowed))
+                    return false;
+                column.numbers.assign(narrowed.begin(), narrowed.end());
+            }
+            else if (!in.getVector(column.numbers))
+            {
+                return false;
+            }
+
+            if (!in.getVector(column.sortedRows) || !in.getVector(column.bins) || !in.getVector(column.binEdges))
+                return false;
+
+            column.name.assign(name, nameSize);
+            column.numeric = numeric != 0;
+
+            if (!column.numeric)
+            {
+                if (column.codes.size() != rows || !column.numbers.empty() || !column.sortedRows.empty())
+                    return false;
+                for (Code code : column.codes)
+                {
+                    if (code >= column.dictionary.size())
+                        return false;
+                }
+                continue;
+            }
+
+            if (!column.codes.empty() || column.numbers.size() != rows || column.sortedRows.size() != rows ||
+                column.bins.size() != rows || column.binEdges.size() > maxBins - 2)
+                return false;
+
+            seen.assign(rows, 0);
+            for (int row : column.sortedRows)
+            {
+                if (row < 0 || static_cast<size_t>(row) >= rows || seen[row])
+                    return false;
+                seen[row] = 1;
+            }
+            for (uint8_t bin : column.bins)
+            {
+                if (bin > column.missingBin())
+                    return false;
+            }
+        }
+
+        for (const std::string &name : selection)
+        {
+            if (columnIndex(name) < 0)
+                return false;
+        }
+        return true;
+    }
+
+    // Quantize a numeric column into at most maxBins - 1 value bins of
+    // roughly equal row counts. Bins only end between distinct values, so a
+    // column with few distinct values gets one bin per value and histogram
+    // splits on it see exactly the thresholds an exact scan would.
+    void binColumn(Column &column)
+    {
+        const std::vector<double> &values = column.numbers;
+        const std::vector<int> &sorted = column.sortedRows;
+
+        size_t present = 0;
+        size_t distinct = 0;
+        while (present < rows && !std::isnan(values[sorted[present]]))
+        {
+            if (present == 0 || values[sorted[present - 1]] < values[sorted[present]])
+                distinct++;
+            present++;
+        }
+
+        size_t perBin = distinct < maxBins ? 1 : present / (maxBins - 1) + 1;
+
+        column.binEdges.clear();
+        column.bins.assign(rows, 0);
+        size_t inBin = 0;
+        for (size_t i = 0; i < present; i++)
+        {
+            column.bins[sorted[i]] = static_cast<uint8_t>(column.binEdges.size());
+            inBin++;
+
+            if (i + 1 < present && inBin >= perBin)
+            {
+                double value = values[sorted[i]];
+                double next = values[sorted[i + 1]];
+                if (value < next)
+                {
+                    column.binEdges.push_back(splitPoint(value, next));
+                    inBin = 0;
+                }
+            }
+        }
+
+        for (size_t i = present; i < rows; i++)
+        {
+            column.bins[sorted[i]] = column.missingBin();
+        }
+    }
+
+    // Records of one byte range of a CSV file, encoded against dictionaries
+    // of their own until the ranges are merged
+    struct CsvChunk
+    {
+        const char *begin; // where the first record was expected to start
+        const char *end;   // records starting before this belong to the chunk
+        const char *first; // where the first record actually starts
+        const char *stop;  // where the record after the last one starts
+        size_t rows;
+        size_t badWidth;   // field count of a record of the wrong width, or 0
+        std::vector<Column> columns;
+        std::vector<char> numericCandidate;
+        std::vector<char> sawNumber;
+
+        CsvChunk() : begin(nullptr), end(nullptr), first(nullptr), stop(nullptr), rows(0), badWidth(0) {}
+    };
+
+    // Smallest byte range worth parsing on a thread of its own
+    static const size_t parallelParseBytes = 1 << 20;
+
+    // Start the chunks at line breaks near equally spaced offsets. A line
+    // break only ends a record when the quotes before it are balanced, so
+    // the quotes in front of every offset are counted first, in parallel.
+    // A file that is not valid RFC 4180 may still mislead this guess, which
+    // loadCSV detects and repairs.
+    void splitIntoChunks(std::vector<CsvChunk> &chunks, const char *begin, const char *limit, ThreadPool *pool)
+    {
+        size_t count = chunks.size();
+        size_t step = (limit - begin) / count;
+
+        std::vector<size_t> quotes(count, 0);
+        auto countQuotes = [&](size_t k)
+        {
+            const char *from = begin + k * step;
+            const char *to = k + 1 < count ? from + step : limit;
+            quotes[k] = std::count(from, to, '"');
+        };
+        if (count > 1)
+            pool->parallelFor(count, countQuotes);
+
+        bool inQuotes = false;
+        chunks[0].begin = begin;
+        for (size_t k = 1; k < count; k++)
+        {
+            inQuotes ^= quotes[k - 1] & 1;
+
+            const char *p = begin + k * step;
+            bool quoted = inQuotes;
+            while (p < limit && (quoted || *p != '\n'))
+            {
+                if (*p == '"')
+                    quoted = !quoted;
+                p++;
+            }
+            chunks[k].begin = std::max(p < limit ? p + 1 : limit, chunks[k - 1].begin);
+        }
+
+        for (size_t k = 0; k < count; k++)
+        {
+            chunks[k].end = k + 1 < count ? chunks[k + 1].begin : limit;
+        }
+    }
+
+    // Encode the records of a chunk that start in [begin, chunk.end); the
+    // last one may run on up to limit. Only the fields flagged in keep are
+    // encoded (all if it is empty), one per entry of categorical. Parsing
+    // stops early at a record that does not have width fields.
+    void parseChunk(CsvChunk &chunk, const char *begin, const char *limit, const std::vector<char> &categorical,
+                    const std::vector<char> &keep, size_t width)
+    {
+        size_t kept = categorical.size();
+        chunk.columns.assign(kept, Column());
+        chunk.sawNumber.assign(kept, 0);
+        chunk.numericCandidate.resize(kept);
+        for (size_t i = 0; i < kept; i++)
+        {
+            // Columns stay numeric candidates until a cell fails to parse
+            chunk.numericCandidate[i] = !categorical[i];
+        }
+        chunk.rows = 0;
+        chunk.badWidth = 0;
+
+        CsvReader reader;
+        reader.attach(begin, limit);
+        reader.skipBlankLines();
+        chunk.first = reader.position();
+
+        std::vector<std::string_view> fields;
+        size_t recordWidth;
+        while (reader.position() < chunk.end && reader.readRow(fields, keep, recordWidth))
+        {
+            if (recordWidth != width)
+            {
+                chunk.badWidth = recordWidth;
+                break;
+            }
+
+            for (size_t i = 0; i < kept; i++)
+            {
+                Column &column = chunk.columns[i];
+                column.codes.push_back(column.dictionary.intern(fields[i]));
+
+                if (chunk.numericCandidate[i])
+                {
+                    double value;
+                    if (parseNumber(fields[i], value))
+                    {
+                        column.numbers.push_back(value);
+                        chunk.sawNumber[i] = 1;
+                    }
+                    else if (fields[i].empty())
+                    {
+                        column.numbers.push_back(std::numeric_limits<double>::quiet_NaN());
+                    }
+                    else
+                    {
+                        chunk.numericCandidate[i] = 0;
+                        std::vector<double>().swap(column.numbers);
+                    }
+                }
+            }
+            chunk.rows++;
+            reader.skipBlankLines();
+        }
+
+        chunk.stop = reader.position();
+    }
+
+    // Combine column i of every chunk into columns[i] and finish it. Chunk
+    // dictionaries are interned in chunk order, which hands out codes in the
+    // same first-seen order as reading the whole file front to back.
+    void mergeColumn(size_t i, std::vector<CsvChunk> &chunks)
+    {
+        Column &column = columns[i];
+        bool numeric = true;
+        bool sawNumber = false;
+        for (const CsvChunk &chunk : chunks)
+        {
+            numeric = numeric && chunk.numericCandidate[i];
+            sawNumber = sawNumber || chunk.sawNumber[i];
+        }
+        numeric = numeric && sawNumber;
+
+        if (chunks.size() == 1)
+        {
+            Column &part = chunks[0].columns[i];
+            column.dictionary = std::move(part.dictionary);
+            column.codes = std::move(part.codes);
+            column.numbers = std::move(part.numbers);
+        }
+        else if (numeric)
+        {
+            column.numbers.reserve(rows);
+            for (CsvChunk &chunk : chunks)
+            {
+                const std::vector<double> &numbers = chunk.columns[i].numbers;
+                column.numbers.insert(column.numbers.end(), numbers.begin(), numbers.end());
+            }
+        }
+        else
+        {
+            column.codes.resize(rows);
+            std::vector<Code> remap;
+            size_t offset = 0;
+            for (CsvChunk &chunk : chunks)
+            {
+                const Column &part = chunk.columns[i];
+                remap.resize(part.dictionary.size());
+                for (Code code = 0; code < remap.size(); code++)
+                {
+                    remap[code] = column.dictionary.intern(part.dictionary.value(code));
+                }
+                for (size_t row = 0; row < chunk.rows; row++)
+                {
+                    column.codes[offset + row] = remap[part.codes[row]];
+                }
+                offset += chunk.rows;
+            }
+        }
+
+        for (CsvChunk &chunk : chunks)
+        {
+            chunk.columns[i] = Column();
+        }
+
+        finishColumn(column, numeric);
+    }
+
+    // Keep the numeric or the categorical representation of a loaded column
+    void finishColumn(Column &column, bool numeric)
+    {
+        column.numeric = numeric;
+        if (!numeric)
+        {
+            std::vector<double>().swap(column.numbers);
+            return;
+        }
+
+        column.dictionary = Dictionary();
+        std::vector<Code>().swap(column.codes);
+
+        const std::vector<double> &values = column.numbers;
+        column.sortedRows.resize(rows);
+        for (size_t i = 0; i < rows; i++)
+        {
+            column.sortedRows[i] = i;
+        }
+        std::stable_sort(column.sortedRows.begin(), column.sortedRows.end(), [&](int a, int b)
+        {
+            return numberBefore(values[a], values[b]);
+        });
+
+        binColumn(column);
+    }
+
+public:
+    Dataset() : rows(0) {}
+
+    // Load a CSV file. categoricalColumn, typically the class label, is kept
+    // categorical even if all of its values are numbers. A non-empty
+    // selection loads only the named columns, in file order; the tokenizer
+    // steps over all other fields without decoding them. With a pool, large
+    // files are split into byte ranges that are parsed and encoded in
+    // parallel and then merged; the result is the same either way.
+    bool loadCSV(const std::string &filename, const std::string &categoricalColumn = "", ThreadPool *pool = nullptr,
+                 const std::vector<std::string> &selection = std::vector<std::string>())
+    {
+        columns.clear();
+        rows = 0;
+
+        CsvReader reader;
+        if (!reader.open(filename))
+        {
+            std::cerr << "Error: Cannot open file " << filename << std::endl;
+            return false;
+        }
+
+        std::vector<std::string_view> fields;
+        if (!reader.readRow(fields))
+        {
+            return true;
+        }
+
+        // keep flags the selected header fields; empty keeps them all
+        size_t width = fields.size();
+        std::vector<char> keep;
+        if (!selection.empty())
+        {
+            keep.assign(width, 0);
+            for (const std::string &name : selection)
+            {
+                size_t field = std::find(fields.begin(), fields.end(), name) - fields.begin();
+                if (field == width)
+                {
+                    std::cerr << "Error: Column '" << name << "' not found" << std::endl;
+                    return false;
+                }
+                keep[field] = 1;
+            }
+        }
+
+        std::vector<char> categorical;
+        for (size_t i = 0; i < width; i++)
+        {
+            if (!keep.empty() && !keep[i])
+                continue;
+
+            Column column;
+            column.name = std::string(fields[i]);
+            categorical.push_back(column.name == categoricalColumn);
+            columns.push_back(std::move(column));
+        }
+
+        const char *begin = reader.position();
+        const char *limit = reader.bufferEnd();
+        size_t chunkCount = 1;
+        if (pool)
+            chunkCount = std::max<size_t>(1, std::min(4 * pool->size(), size_t(limit - begin) / parallelParseBytes));
+
+        std::vector<CsvChunk> chunks(chunkCount);
+        splitIntoChunks(chunks, begin, limit, pool);
+
+        auto parse = [&](size_t k)
+        {
+            parseChunk(chunks[k], chunks[k].begin, limit, categorical, keep, width);
+        };
+        if (chunks.size() > 1)
+        {
+            pool->parallelFor(chunks.size(), parse);
+        }
+        else
+        {
+            parse(0);
+        }
+
+        // A chunk whose start was guessed wrongly, inside a record of the
+        // chunk before it, is parsed again from where that chunk stopped
+        for (size_t k = 0; k < chunks.size(); k++)
+        {
+            if (k > 0 && chunks[k].first != chunks[k - 1].stop)
+                parseChunk(chunks[k], chunks[k - 1].stop, limit, categorical, keep, width);
+
+            if (chunks[k].badWidth != 0)
+            {
+                std::cerr << "Error: Record " << rows + chunks[k].rows + 1 << " has " << chunks[k].badWidth
+                          << " fields, expected " << width << std::endl;
+                columns.clear();
+                rows = 0;
+                return false;
+            }
+            rows += chunks[k].rows;
+        }
+
+        auto merge = [&](size_t i)
+        {
+            mergeColumn(i, chunks);
+        };
+        if (pool && columns.size() > 1)
+        {
+            pool->parallelFor(columns.size(), merge);
+        }
+        else
+        {
+            for (size_t i = 0; i < columns.size(); i++)
+            {
+                merge(i);
+            }
+        }
+
+        return true;
+    }
+
+    // Load a CSV file through a binary cache of the encoded table kept next
+    // to it as filename + ".dtcache". The cache is used when it was built
+    // from a file of the same size and modification time with the same
+    // categoricalColumn, and holds every column of the selection (every
+    // column of the file if the selection is empty); otherwise the CSV is
+    // parsed and the cache rebuilt from what was loaded.
+    bool loadCached(const std::string &filename, const std::string &categoricalColumn = "", ThreadPool *pool = nullptr,
+                    const std::vector<std::string> &selection = std::vector<std::string>())
+    {
+        std::error_code error;
+        uint64_t sourceSize = std::filesystem::file_size(filename, error);
+        int64_t sourceTime = 0;
+        if (!error)
+            sourceTime = std::filesystem::last_write_time(filename, error).time_since_epoch().count();
+        if (error)
+            return loadCSV(filename, categoricalColumn, pool, selection);
+
+        std::string cacheFile = filename + ".dtcache";
+        {
+            MappedFile file;
+            BinaryReader in;
+            uint64_t cachedSize, nameSize;
+            int64_t cachedTime;
+            uint32_t complete;
+            const char *name;
+            if (mapBinaryFile(file, cacheFile, "DTCACHE", cacheVersion, sizeof(Code), in) == binaryOk &&
+                in.get(cachedSize) && in.get(cachedTime) && in.get(nameSize) && (name = in.array<char>(nameSize)) &&
+                in.get(complete) && cachedSize == sourceSize && cachedTime == sourceTime &&
+                std::string_view(name, nameSize) == categoricalColumn && (complete || !selection.empty()))
+            {
+                if (readTable(in, selection) && in.atEnd())
+                    return true;
+            }
+        }
+
+        if (!loadCSV(filename, categoricalColumn, pool, selection))
+            return false;
+
+        BinaryWriter out;
+        out.put(sourceSize);
+        out.put(sourceTime);
+        out.put<uint64_t>(categoricalColumn.size());
+        out.array(categoricalColumn.data(), categoricalColumn.size());
+        out.put<uint32_t>(selection.empty());
+        writeTable(out);
+        if (!writeBinaryFile(cacheFile, "DTCACHE", cacheVersion, sizeof(Code), out))
+            std::cerr << "Warning: Cannot write dataset cache " << cacheFile << std::endl;
+
+        return true;
+    }
+
+    size_t rowCount() const { return rows; }
+    size_t columnCount() const { return columns.size(); }
+    const Column &column(int index) const { return columns[index]; }
+
+    // Column index by name, or -1 if there is no such column
+    int columnIndex(const std::string &name) const
+    {
+        for (size_t i = 0; i < columns.size(); i++)
+        {
+            if (columns[i].name == name)
+                return static_cast<int>(i);
+        }
+        return -1;
+    }
+
+    // Store the column names and types, but none of the rows. Only the
+    // columns flagged in withDictionary keep their dictionaries; the others
+    // are stored with empty ones, which encode every value as unseen.
+    void writeSchema(BinaryWriter &out, const std::vector<char> &withDictionary) const
+    {
+        Dictionary empty;
+        out.put<uint64_t>(columns.size());
+        for (size_t i = 0; i < columns.size(); i++)
+        {
+            const Column &column = columns[i];
+            out.put<uint64_t>(column.name.size());
+            out.array(column.name.data(), column.name.size());
+            out.put<uint32_t>(column.numeric);
+            (withDictionary[i] ? column.dictionary : empty).write(out);
+        }
+    }
+
+    // Replace the dataset with a schema stored by writeSchema and no rows
+    bool readSchema(BinaryReader &in)
+    {
+        columns.clear();
+        rows = 0;
+
+        uint64_t columnCount;
+        if (!in.get(columnCount) || columnCount > std::numeric_limits<int>::max())
+            return false;
+
+        for (uint64_t i = 0; i < columnCount; i++)
+        {
+            Column column;
+            uint64_t nameSize;
+            uint32_t numeric;
+            const char *name;
+            if (!in.get(nameSize) || !(name = in.array<char>(nameSize)) || !in.get(numeric) ||
+                !column.dictionary.read(in))
+            {
+                columns.clear();
+                return false;
+            }
+
+            column.name.assign(name, nameSize);
+            column.numeric = numeric != 0;
+            columns.push_back(std::move(column));
+        }
+        return true;
+    }
+};
+
+// Rows encoded against a trained dataset's columns and stored column by
+// column, ready for batch prediction. Categorical cells hold the training
+// dictionary's code (Dictionary::npos for values never seen in training,
+// EncodedBlock::missing for empty ones) and numeric cells the parsed number
+// (NaN when empty or unparseable). Columns the input does not have are left
+// unbound, and rows cannot supply them.
+class EncodedBlock
+{
+public:
+    static constexpr Code missing = Dictionary::npos - 1;
+
+private:
+    const Dataset *schema;
+    std::vector<int> source; // per schema column, index among the kept fields or -1
+    std::vector<char> keep;  // per input field, whether it is read at all
+    std::vector<std::vector<Code>> codes;
+    std::vector<std::vector<double>> numbers;
+    size_t rows;
+
+public:
+    // Read-only view of one row, as used by FlatTree
+    struct Row
+    {
+        const EncodedBlock &block;
+        size_t index;
+
+        bool code(int feature, Code &value) const
+        {
+            if (block.source[feature] < 0)
+                return false;
+            value = block.codes[feature][index];
+            return value != missing;
+        }
+
+        bool number(int feature, double &value) const
+        {
+            if (block.source[feature] < 0)
+                return false;
+            value = block.numbers[feature][index];
+            return true;
+        }
+    };
+
+    EncodedBlock() : schema(nullptr), rows(0) {}
+
+    // Match the input's header against the schema's columns by name. Only
+    // the columns flagged in used are bound, or all of them if used is
+    // empty; records must then be read with fieldMask() so that they hold
+    // just the bound fields, in input order.
+    void bind(const Dataset &dataset, const std::vector<std::string_view> &header,
+              const std::vector<char> &used = std::vector<char>())
+    {
+        schema = &dataset;
+        source.assign(dataset.columnCount(), -1);
+        keep.assign(header.size(), 0);
+        codes.assign(dataset.columnCount(), std::vector<Code>());
+        numbers.assign(dataset.columnCount(), std::vector<double>());
+        rows = 0;
+
+        std::vector<int> columnOf(header.size(), -1);
+        for (size_t i = 0; i < header.size(); i++)
+        {
+            int column = dataset.columnIndex(std::string(header[i]));
+            if (column >= 0 && source[column] < 0 && (used.empty() || used[column]))
+            {
+                source[column] = 0;
+                columnOf[i] = column;
+                keep[i] = 1;
+            }
+        }
+
+        int kept = 0;
+        for (size_t i = 0; i < header.size(); i++)
+        {
+            if (keep[i])
+                source[columnOf[i]] = kept++;
+        }
+    }
+
+    // Per input field, whether bind kept it; for CsvReader::readRow
+    const std::vector<char> &fieldMask() const { return keep; }
+
+    // Drop the rows but keep the binding and the buffers
+    void clear()
+    {
+        for (size_t i = 0; i < source.size(); i++)
+        {
+            codes[i].clear();
+            numbers[i].clear();
+        }
+        rows = 0;
+    }
+
+    // Encode one record of the bound input
+    void append(const std::vector<std::string_view> &fields)
+    {
+        for (size_t i = 0; i < source.size(); i++)
+        {
+            if (source[i] < 0)
+                continue;
+
+            std::string_view field = static_cast<size_t>(source[i]) < fields.size() ? fields[source[i]] : std::string_view();
+            const Column &column = schema->column(i);
+            if (column.numeric)
+            {
+                double value;
+                if (!parseNumber(field, value))
+                    value = std::numeric_limits<double>::quiet_NaN();
+                numbers[i].push_back(value);
+            }
+            else
+            {
+                codes[i].push_back(field.empty() ? missing : column.dictionary.find(field));
+            }
+        }
+        rows++;
+    }
+
+    size_t rowCount() const { return rows; }
+    Row row(size_t index) const { return Row{*this, index}; }
+};
+
+// Open a CSV file for encoding: read its header and bind block to the
+// columns of schema flagged in used
+bool openEncodedCSV(CsvReader &reader, const std::string &filename, const Dataset &schema,
+                    const std::vector<char> &used, EncodedBlock &block)
+{
+    if (!reader.open(filename))
+    {
+        std::cerr << "Error: Cannot open file " << filename << std::endl;
+        return false;
+    }
+
+    std::vector<std::string_view> fields;
+    if (!reader.readRow(fields))
+        fields.clear();
+    block.bind(schema, fields, used);
+    return true;
+}
+
+// Replace the rows of block with up to maxRows further records of reader,
+// reading only the bound fields. Returns false once the file is exhausted.
+bool readEncodedBlock(CsvReader &reader, EncodedBlock &block, size_t maxRows)
+{
+    std::vector<std::string_view> fields;
+    size_t width;
+    block.clear();
+    while (block.rowCount() < maxRows)
+    {
+        if (!reader.readRow(fields, block.fieldMask(), width))
+            return false;
+        block.append(fields);
+    }
+    return true;
+}
+
+// Row view of a prediction instance given as feature=value pairs
+struct InstanceRow
+{
+    const Dataset &data;
+    const std::map<std::string, std::string> &instance;
+
+    // An absent or empty value is missing
+    bool code(int feature, Code &value) const
+    {
+        const Column &column = data.column(feature);
+        auto it = instance.find(column.name);
+        if (it == instance.end() || it->second.empty())
+            return false;
+        value = column.dictionary.find(it->second);
+        return true;
+    }
+
+    // As in batch scoring, a value that does not parse is missing too
+    bool number(int feature, double &value) const
+    {
+        auto it = instance.find(data.column(feature).name);
+        return it != instance.end() && parseNumber(it->second, value);
+    }
+};
+
+// Rows of a loaded dataset as a block for FlatTree::findLeaves: all rows in
+// order, or the rows listed in an index array. Cells are read in place.
+class TableBlock
+{
+private:
+    const Dataset &data;
+    const int *rows;
+    std::vector<Code> missing; // per column, the code of a missing cell
+
+public:
+    struct Row
+    {
+        const TableBlock &block;
+        size_t index;
+
+        bool code(int feature, Code &value) const
+        {
+            value = block.data.column(feature).codes[index];
+            return value != block.missing[feature];
+        }
+
+        bool number(int feature, double &value) const
+        {
+            value = block.data.column(feature).numbers[index];
+            return true;
+        }
+    };
+
+    explicit TableBlock(const Dataset &dataset, const int *rowIndices = nullptr) : data(dataset), rows(rowIndices)
+    {
+        for (size_t i = 0; i < data.columnCount(); i++)
+        {
+            missing.push_back(data.column(i).missingCode());
+        }
+    }
+
+    Row row(size_t i) const { return Row{*this, rows ? static_cast<size_t>(rows[i]) : i}; }
+};
+
+// Half-open span of row indices, inside the builder's shared index array or
+// a caller's list of training rows
+struct RowSpan
+{
+    const int *first;
+    const int *last;
+
+    const int *begin() const { return first; }
+    const int *end() const { return last; }
+    size_t size() const { return last - first; }
+    bool empty() const { return first == last; }
+    int operator[](size_t i) const { return first[i]; }
+};
+
+// Calculate entropy of a class histogram
+double calculateEntropy(const int *classCounts, size_t classCount, int total)
+{
+    if (total == 0)
+        return 0.0;
+
+    double entropy = 0.0;
+    for (size_t c = 0; c < classCount; c++)
+    {
+        if (classCounts[c] > 0)
+        {
+            double prob = static_cast<double>(classCounts[c]) / total;
+            entropy -= prob * log2(prob);
+        }
+    }
+
+    return entropy;
+}
+
+// Split statistics for one candidate feature at one node: a flat
+// (feature value x class) count matrix filled in a single pass over the
+// node's rows. The buffers are kept between calls and only the cells that a
+// tally touched are cleared again, so evaluating a split never allocates once
+// the buffers have grown and costs time linear in the number of rows.
+class SplitStatistics
+{
+private:
+    std::vector<int> counts;      // counts[value * classCount + class]
+    std::vector<int> valueTotals; // rows per feature value
+    std::vector<int> classTotals; // rows per class
+    std::vector<int> leftCounts;  // classes below a threshold
+    std::vector<int> rightCounts; // classes above a threshold
+    std::vector<int> missingCounts; // classes of the rows missing a threshold's value
+    std::vector<Code> present;    // feature values seen by the current tally
+    size_t classCount;
+    int total;
+    int missingTotal;
+
+    void reset()
+    {
+        for (Code value : present)
+        {
+            std::fill_n(counts.begin() + value * classCount, classCount, 0);
+            valueTotals[value] = 0;
+        }
+        present.clear();
+        std::fill(classTotals.begin(), classTotals.end(), 0);
+    }
+
+    // Size-weighted entropy of a threshold split with leftTotal rows on the
+    // left, whose classes are in leftCounts, and the others on the right
+    double splitEntropy(int leftTotal)
+    {
+        int rightTotal = total - leftTotal;
+        for (size_t c = 0; c < classCount; c++)
+        {
+            rightCounts[c] = classTotals[c] - leftCounts[c];
+        }
+
+        return (leftTotal * calculateEntropy(leftCounts.data(), classCount, leftTotal) +
+                rightTotal * calculateEntropy(rightCounts.data(), classCount, rightTotal)) /
+               total;
+    }
+
+    // Gain of the threshold split whose present rows below it are in
+    // leftCounts, with the missing rows on whichever side gains more. Ties
+    // keep them right. Sides with fewer than minLeaf rows are not allowed;
+    // returns -1 if neither placement is.
+    double thresholdGain(double parentEntropy, int leftTotal, int minLeaf, bool &missingLeft)
+    {
+        double gain = -1.0;
+        missingLeft = false;
+        if (leftTotal >= minLeaf && total - leftTotal >= minLeaf)
+            gain = parentEntropy - splitEntropy(leftTotal);
+        if (missingTotal == 0 || leftTotal + missingTotal < minLeaf || total - missingTotal - leftTotal < minLeaf)
+            return gain;
+
+        for (size_t c = 0; c < classCount; c++)
+        {
+            leftCounts[c] += missingCounts[c];
+        }
+        double joined = parentEntropy - splitEntropy(leftTotal + missingTotal);
+        for (size_t c = 0; c < classCount; c++)
+        {
+            leftCounts[c] -= missingCounts[c];
+        }
+
+        if (joined > gain)
+        {
+            missingLeft = true;
+            return joined;
+        }
+        return gain;
+    }
+
+public:
+    SplitStatistics() : classCount(0), total(0), missingTotal(0) {}
+
+    void tally(const Column &feature, const Column &target, RowSpan indices)
+    {
+        reset();
+
+        classCount = target.dictionary.size();
+        size_t valueCount = feature.dictionary.size();
+        if (counts.size() < valueCount * classCount)
+            counts.resize(valueCount * classCount, 0);
+        if (valueTotals.size() < valueCount)
+            valueTotals.resize(valueCount, 0);
+        classTotals.assign(classCount, 0);
+
+        const Code *values = feature.codes.data();
+        const Code *classes = target.codes.data();
+        for (int idx : indices)
+        {
+            Code value = values[idx];
+            if (valueTotals[value]++ == 0)
+                present.push_back(value);
+            counts[value * classCount + classes[idx]]++;
+            classTotals[classes[idx]]++;
+        }
+        total = static_cast<int>(indices.size());
+    }
+
+    // Parent entropy minus the size-weighted entropy of the children, with
+    // one child per present value other than missing. The missing rows join
+    // the child where they cost the least entropy, and joined receives that
+    // child's value; without missing rows it is the largest child's. Returns
+    // -1 if every row is missing or a child would have fewer than minLeaf
+    // rows of its own.
+    double informationGain(Code missing, int minLeaf, Code &joined)
+    {
+        int missingTotal = 0;
+        if (missing != Dictionary::npos && missing < valueTotals.size())
+            missingTotal = valueTotals[missing];
+
+        double weightedEntropy = 0.0;
+        for (Code value : present)
+        {
+            if (value == missing)
+                continue;
+            if (valueTotals[value] < minLeaf)
+                return -1.0;
+            double weight = static_cast<double>(valueTotals[value]) / total;
+            weightedEntropy += weight * calculateEntropy(&counts[value * classCount], classCount, valueTotals[value]);
+        }
+
+        // Try the missing rows in each child and keep the cheapest, breaking
+        // ties towards the smaller code so the choice is independent of row
+        // order
+        double bestEntropy = 0.0;
+        joined = Dictionary::npos;
+        for (Code value : present)
+        {
+            if (value == missing)
+                continue;
+
+            double entropy = weightedEntropy;
+            if (missingTotal > 0)
+            {
+                const int *valueCounts = &counts[value * classCount];
+                const int *missingCounts = &counts[missing * classCount];
+                leftCounts.resize(classCount);
+                for (size_t c = 0; c < classCount; c++)
+                {
+                    leftCounts[c] = valueCounts[c] + missingCounts[c];
+                }
+
+                int joinedTotal = valueTotals[value] + missingTotal;
+                entropy += static_cast<double>(joinedTotal) / total * calculateEntropy(leftCounts.data(), classCount, joinedTotal) -
+                           static_cast<double>(valueTotals[value]) / total * calculateEntropy(valueCounts, classCount, valueTotals[value]);
+            }
+
+            if (joined != Dictionary::npos)
+            {
+                bool better = missingTotal > 0 ? entropy < bestEntropy : valueTotals[value] > valueTotals[joined];
+                bool tied = missingTotal > 0 ? entropy == bestEntropy : valueTotals[value] == valueTotals[joined];
+                if (!better && !(tied && value < joined))
+                    continue;
+            }
+
+            bestEntropy = entropy;
+            joined = value;
+        }
+
+        if (joined == Dictionary::npos)
+            return -1.0;
+        return calculateEntropy(classTotals.data(), classCount, total) - bestEntropy;
+    }
+
+    // Best binary split "value <= threshold" of a numeric feature. The rows
+    // must be given in ascending value order with missing values last; those
+    // go to the side that gains more, reported through missingLeft. Returns
+    // the gain, or -1 if no threshold separates the present rows into sides
+    // of at least minLeaf rows.
+    double bestThreshold(const Column &feature, const Column &target, RowSpan sorted, int minLeaf, double &threshold,
+                         bool &missingLeft)
+    {
+        reset();
+
+        classCount = target.dictionary.size();
+        classTotals.assign(classCount, 0);
+        leftCounts.assign(classCount, 0);
+        rightCounts.resize(classCount);
+        missingCounts.assign(classCount, 0);
+
+        const double *values = feature.numbers.data();
+        const Code *classes = target.codes.data();
+        missingTotal = 0;
+        for (int idx : sorted)
+        {
+            classTotals[classes[idx]]++;
+            if (std::isnan(values[idx]))
+            {
+                missingCounts[classes[idx]]++;
+                missingTotal++;
+            }
+        }
+        total = static_cast<int>(sorted.size());
+
+        double parentEntropy = calculateEntropy(classTotals.data(), classCount, total);
+        double bestGain = -1.0;
+
+        // Move rows left one at a time and score every boundary between two
+        // distinct values
+        for (size_t i = 0; i + 1 < sorted.size(); i++)
+        {
+            leftCounts[classes[sorted[i]]]++;
+
+            double value = values[sorted[i]];
+            double next = values[sorted[i + 1]];
+            if (std::isnan(next))
+                break;
+            if (!(value < next))
+                continue;
+
+            bool left;
+            double gain = thresholdGain(parentEntropy, i + 1, minLeaf, left);
+            if (gain > bestGain)
+            {
+                bestGain = gain;
+                threshold = splitPoint(value, next);
+                missingLeft = left;
+            }
+        }
+
+        return bestGain;
+    }
+
+    // Same search as bestThreshold, over a numeric feature's (bin x class)
+    // histogram for the node instead of its rows. Only bin edges are
+    // candidate thresholds, and the missing bin goes either way.
+    double bestBinnedThreshold(const Column &feature, const Column &target, const int *histogram, int minLeaf,
+                               double &threshold, bool &missingLeft)
+    {
+        reset();
+
+        classCount = target.dictionary.size();
+        classTotals.assign(classCount, 0);
+        leftCounts.assign(classCount, 0);
+        rightCounts.resize(classCount);
+        missingCounts.assign(classCount, 0);
+
+        size_t binCount = feature.binCount();
+        for (size_t b = 0; b < binCount; b++)
+        {
+            for (size_t c = 0; c < classCount; c++)
+            {
+                classTotals[c] += histogram[b * classCount + c];
+            }
+        }
+
+        missingTotal = 0;
+        for (size_t c = 0; c < classCount; c++)
+        {
+            missingCounts[c] = histogram[feature.missingBin() * classCount + c];
+            missingTotal += missingCounts[c];
+        }
+
+        total = 0;
+        for (int count : classTotals)
+        {
+            total += count;
+        }
+
+        double parentEntropy = calculateEntropy(classTotals.data(), classCount, total);
+        double bestGain = -1.0;
+        int leftTotal = 0;
+
+        for (size_t b = 0; b < feature.binEdges.size(); b++)
+        {
+            int binTotal = 0;
+            for (size_t c = 0; c < classCount; c++)
+            {
+                leftCounts[c] += histogram[b * classCount + c];
+                binTotal += histogram[b * classCount + c];
+            }
+            leftTotal += binTotal;
+
+            int rightTotal = total - leftTotal;
+            if (rightTotal == missingTotal)
+                break;
+            if (leftTotal == 0 || binTotal == 0)
+                continue;
+
+            bool left;
+            double gain = thresholdGain(parentEntropy, leftTotal, minLeaf, left);
+            if (gain > bestGain)
+            {
+                bestGain = gain;
+                threshold = feature.binEdges[b];
+                missingLeft = left;
+            }
+        }
+
+        return bestGain;
+    }
+};
+
+// Split statistics scratch space of the calling thread
+SplitStatistics &threadStatistics()
+{
+    thread_local SplitStatistics stats;
+    return stats;
+}
+
+// Bitset over column indices. Tables of up to 256 columns fit in the inline
+// words, so the mask can be passed by value through the recursion without
+// touching the heap; wider tables spill into a vector.
+class FeatureMask
+{
+private:
+    static const size_t inlineWords = 4;
+    size_t width;
+    size_t wordCount;
+    uint64_t inlineBits[inlineWords];
+    std::vector<uint64_t> heapBits;
+
+    uint64_t *words() { return heapBits.empty() ? inlineBits : heapBits.data(); }
+    const uint64_t *words() const { return heapBits.empty() ? inlineBits : heapBits.data(); }
+
+public:
+    explicit FeatureMask(size_t width = 0) : width(width), wordCount((width + 63) / 64)
+    {
+        std::fill_n(inlineBits, inlineWords, 0);
+        if (wordCount > inlineWords)
+            heapBits.assign(wordCount, 0);
+    }
+
+    bool test(size_t index) const { return (words()[index / 64] >> (index % 64)) & 1; }
+    void set(size_t index) { words()[index / 64] |= uint64_t(1) << (index % 64); }
+
+    // Call fn with every index below the width whose bit is clear, in order
+    template <typename Fn>
+    void forEachUnset(Fn fn) const
+    {
+        const uint64_t *bits = words();
+        for (size_t word = 0; word < wordCount; word++)
+        {
+            uint64_t unset = ~bits[word];
+            if (word == wordCount - 1 && width % 64 != 0)
+                unset &= (uint64_t(1) << (width % 64)) - 1;
+
+            while (unset != 0)
+            {
+                fn(static_cast<int>(word * 64 + countTrailingZeros(unset)));
+                unset &= unset - 1;
+            }
+        }
+    }
+};
+
+struct TreeNode
+{
+    int feature;      // column index of the split, -1 for leaves
+    double threshold; // numeric splits send value <= threshold to children[0]
+    std::string value;
+    std::string prediction;
+    std::vector<int> classCounts; // leaves: training rows per class code
+    std::vector<float> scores;    // leaves of boosted trees: the output, instead of classCounts
+    bool isLeaf;
+    int missingChild; // child that rows missing the feature go to
+    int missingRows;  // training rows that went there for lack of a value
+    std::vector<std::unique_ptr<TreeNode>> children;
+
+    TreeNode() : feature(-1), threshold(0.0), isLeaf(false), missingChild(-1), missingRows(0) {}
+};
+
+// Best split found for a node
+struct SplitCandidate
+{
+    int feature; // column index, -1 if there is nothing to split on
+    double gain;
+    double threshold;
+    bool missingLeft; // numeric splits: missing values go to the first child
+    Code joined;      // categorical splits: value whose child takes the missing rows
+
+    SplitCandidate() : feature(-1), gain(-1.0), threshold(0.0), missingLeft(false), joined(Dictionary::npos) {}
+};
+
+// How many of the features a node draws its split candidates from
+enum FeatureSubset
+{
+    allFeatures,
+    sqrtFeatures,
+    log2Features
+};
+
+// Name of a feature subset as --max-features spells it
+const char *featureSubsetName(FeatureSubset subset)
+{
+    return subset == sqrtFeatures ? "sqrt" : subset == log2Features ? "log2" : "all";
+}
+
+// Limits on the growth of one tree. The defaults grow it until its leaves
+// are pure or nothing separates their rows, as plain ID3 does.
+struct TreeParams
+{
+    int maxDepth;              // 0 for no limit
+    int minSamplesSplit;       // nodes with fewer rows become leaves
+    int minSamplesLeaf;        // splits leaving a branch fewer rows are skipped
+    FeatureSubset maxFeatures; // drawn at random, without replacement, per node
+
+    TreeParams() : maxDepth(0), minSamplesSplit(2), minSamplesLeaf(1), maxFeatures(allFeatures) {}
+
+    // Candidates per node out of featureCount features
+    size_t featuresPerSplit(size_t featureCount) const
+    {
+        if (maxFeatures == sqrtFeatures)
+            return std::max<size_t>(1, static_cast<size_t>(std::sqrt(static_cast<double>(featureCount))));
+        if (maxFeatures == log2Features)
+            return std::max<size_t>(1, static_cast<size_t>(std::log2(static_cast<double>(std::max<size_t>(featureCount, 1)))));
+        return featureCount;
+    }
+};
+
+// SplitMix64 generator. Its state is a single word, so every tree and node
+// derives its own stream from a seed and results do not depend on which
+// thread builds what.
+class SplitMix
+{
+private:
+    uint64_t state;
+
+public:
+    explicit SplitMix(uint64_t seed) : state(seed) {}
+
+    uint64_t next()
+    {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    // Uniform integer below bound, which must fit in 32 bits
+    uint32_t below(uint64_t bound) { return static_cast<uint32_t>(((next() >> 32) * bound) >> 32); }
+
+    // Seed of the stream numbered index that derives from seed
+    static uint64_t derive(uint64_t seed, uint64_t index) { return SplitMix(seed ^ (index * 0xD1B54A32D192ED03ull)).next(); }
+};
+
+// Node of a compiled tree. The children of a node are stored next to each
+// other, so a prediction walks one contiguous array and compares integers.
+// A categorical node finds the child for a code in one probe of its dispatch
+// table: indexed by the code itself when the column's dictionary is small,
+// otherwise through a multiplicative perfect hash of the node's child codes.
+struct FlatNode
+{
+    int32_t feature;     // column index of the split, -1 for leaves
+    uint32_t firstChild; // children are nodes[firstChild, firstChild + childCount)
+    uint32_t childCount;
+    Code value;          // code of the categorical value leading here from the parent
+    Code prediction;     // class code at leaves
+    uint32_t numeric;    // numeric split: value <= threshold goes to the first child
+    double threshold;
+
+    uint32_t table;     // offset of the dispatch table in FlatTree::dispatch
+    uint32_t tableSize; // slots in the table
+    uint32_t seed;      // hash multiplier, 0 for a table indexed by code
+    uint32_t shift;     // slot = (code * seed) >> shift
+
+    uint32_t distribution; // leaves: offset of the class probabilities, or FlatTree::noChild
+    uint32_t missingChild; // internal nodes: child taking rows without a value, or FlatTree::noChild
+
+    FlatNode()
+        : feature(-1), firstChild(0), childCount(0), value(0), prediction(0), numeric(0), threshold(0.0),
+          table(0), tableSize(0), seed(0), shift(0), distribution(0xFFFFFFFFu), missingChild(0xFFFFFFFFu) {}
+};
+
+static_assert(sizeof(FlatNode) == 56, "FlatNode is stored as is in model files");
+
+// Read-only array that either points into a vector or into a mapped file
+template <typename T>
+struct ArrayView
+{
+    const T *first;
+    size_t count;
+
+    ArrayView() : first(nullptr), count(0) {}
+    ArrayView(const T *data, size_t size) : first(data), count(size) {}
+
+    const T &operator[](size_t i) const { return first[i]; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+};
+
+// Inference form of a trained tree, laid out breadth-first. Walks read the
+// arrays through views, which point either at the tree's own storage after
+// compiling or straight into a mapped model file.
+class FlatTree
+{
+public:
+    static constexpr Code unknown = Dictionary::npos;
+    static constexpr uint32_t noChild = 0xFFFFFFFFu;
+
+    // Filled while compiling; publish() points the views at them
+    std::vector<FlatNode> nodeStorage;
+    std::vector<uint32_t> dispatchStorage;
+    std::vector<float> probabilityStorage;
+
+    ArrayView<FlatNode> nodes;
+    ArrayView<uint32_t> dispatch;   // child index + 1 per slot, 0 for no child
+    ArrayView<float> probabilities; // per leaf, the training class frequencies or a boosted tree's score
+
+    void publish()
+    {
+        nodes = ArrayView<FlatNode>(nodeStorage.data(), nodeStorage.size());
+        dispatch = ArrayView<uint32_t>(dispatchStorage.data(), dispatchStorage.size());
+        probabilities = ArrayView<float>(probabilityStorage.data(), probabilityStorage.size());
+    }
+
+    void write(BinaryWriter &out) const
+    {
+        out.put<uint64_t>(nodes.size());
+        out.put<uint64_t>(dispatch.size());
+        out.put<uint64_t>(probabilities.size());
+        out.array(nodes.first, nodes.size());
+        out.array(dispatch.first, dispatch.size());
+        out.array(probabilities.first, probabilities.size());
+    }
+
+    // Point the views at a tree stored by write(), without copying it. The
+    // nodes are checked against the schema so that no walk can leave the
+    // arrays or read a column the wrong way.
+    bool read(BinaryReader &in, const Dataset &schema, size_t classCount)
+    {
+        uint64_t nodeCount, dispatchCount, probabilityCount;
+        if (!in.get(nodeCount) || !in.get(dispatchCount) || !in.get(probabilityCount))
+            return false;
+
+        const FlatNode *storedNodes = in.array<FlatNode>(nodeCount);
+        const uint32_t *storedDispatch = in.array<uint32_t>(dispatchCount);
+        const float *storedProbabilities = in.array<float>(probabilityCount);
+        if (!storedNodes || !storedDispatch || !storedProbabilities)
+            return false;
+
+        for (uint64_t i = 0; i < nodeCount; i++)
+        {
+            const FlatNode &node = storedNodes[i];
+            if (node.feature < 0)
+            {
+                if (node.prediction >= classCount && node.prediction != unknown)
+                    return false;
+                if (node.distribution != noChild && uint64_t(node.distribution) + classCount > probabilityCount)
+                    return false;
+                continue;
+            }
+
+            // Children always come after their parent, so walks terminate
+            if (size_t(node.feature) >= schema.columnCount() || node.firstChild <= i ||
+                uint64_t(node.firstChild) + node.childCount > nodeCount)
+                return false;
+
+            bool numeric = schema.column(node.feature).numeric;
+            if (node.numeric != (numeric ? 1u : 0u))
+                return false;
+            if (node.missingChild != noChild && node.missingChild >= node.childCount)
+                return false;
+            if (numeric)
+            {
+                if (node.childCount != 2)
+                    return false;
+                continue;
+            }
+
+            if (uint64_t(node.table) + node.tableSize > dispatchCount || (node.seed != 0 && node.shift >= 32))
+                return false;
+            for (uint32_t slot = 0; slot < node.tableSize; slot++)
+            {
+                if (storedDispatch[node.table + slot] > node.childCount)
+                    return false;
+            }
+        }
+
+        nodeStorage.clear();
+        dispatchStorage.clear();
+        probabilityStorage.clear();
+        nodes = ArrayView<FlatNode>(storedNodes, nodeCount);
+        dispatch = ArrayView<uint32_t>(storedDispatch, dispatchCount);
+        probabilities = ArrayView<float>(storedProbabilities, probabilityCount);
+        return true;
+    }
+
+    // Build the dispatch table of a categorical node whose children are in
+    // place. Small dictionaries get a table indexed by code; larger ones get
+    // the smallest perfect hash table found for the node's child codes, as
+    // long as it is still smaller than the dictionary.
+    void buildDispatch(FlatNode &node, size_t dictionarySize)
+    {
+        const size_t denseLimit = 64;
+        node.table = dispatchStorage.size();
+
+        if (dictionarySize > denseLimit && dictionarySize > 4 * size_t(node.childCount))
+        {
+            std::vector<uint32_t> slots;
+            for (uint32_t bits = 1; (size_t(1) << bits) < dictionarySize; bits++)
+            {
+                uint32_t size = uint32_t(1) << bits;
+                if (size < node.childCount)
+                    continue;
+
+                for (uint32_t attempt = 1; attempt <= 64; attempt++)
+                {
+                    uint32_t seed = (0x9E3779B9u * attempt) | 1u;
+                    uint32_t shift = 32 - bits;
+                    slots.assign(size, 0);
+
+                    bool collision = false;
+                    for (uint32_t child = 0; child < node.childCount && !collision; child++)
+                    {
+                        uint32_t slot = (nodeStorage[node.firstChild + child].value * seed) >> shift;
+                        collision = slots[slot] != 0;
+                        slots[slot] = child + 1;
+                    }
+
+                    if (!collision)
+                    {
+                        node.tableSize = size;
+                        node.seed = seed;
+                        node.shift = shift;
+                        dispatchStorage.insert(dispatchStorage.end(), slots.begin(), slots.end());
+                        return;
+                    }
+                }
+            }
+        }
+
+        node.tableSize = dictionarySize;
+        node.seed = 0;
+        node.shift = 0;
+        dispatchStorage.resize(dispatchStorage.size() + dictionarySize, 0);
+        for (uint32_t child = 0; child < node.childCount; child++)
+        {
+            dispatchStorage[node.table + nodeStorage[node.firstChild + child].value] = child + 1;
+        }
+    }
+
+    // Lay a finished tree out breadth-first, with branch values and
+    // predictions replaced by their codes in data's dictionaries
+    void compile(const TreeNode *root, const Dataset &data, int targetId)
+    {
+        nodeStorage.clear();
+        dispatchStorage.clear();
+        probabilityStorage.clear();
+        publish();
+        if (!root)
+            return;
+
+        const Column &target = data.column(targetId);
+        std::vector<const TreeNode *> order(1, root);
+        nodeStorage.resize(1);
+
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            const TreeNode *node = order[i];
+            if (node->isLeaf && !node->scores.empty())
+            {
+                nodeStorage[i].prediction = unknown;
+                nodeStorage[i].distribution = probabilityStorage.size();
+                probabilityStorage.insert(probabilityStorage.end(), node->scores.begin(), node->scores.end());
+                continue;
+            }
+            if (node->isLeaf)
+            {
+                nodeStorage[i].prediction = target.dictionary.find(node->prediction);
+
+                int total = 0;
+                for (int count : node->classCounts)
+                {
+                    total += count;
+                }
+                if (total > 0)
+                {
+                    nodeStorage[i].distribution = probabilityStorage.size();
+                    for (int count : node->classCounts)
+                    {
+                        probabilityStorage.push_back(static_cast<float>(count) / total);
+                    }
+                }
+                continue;
+            }
+
+            const Column &column = data.column(node->feature);
+            nodeStorage[i].feature = node->feature;
+            nodeStorage[i].numeric = column.numeric;
+            nodeStorage[i].threshold = node->threshold;
+            nodeStorage[i].firstChild = order.size();
+            nodeStorage[i].childCount = node->children.size();
+            nodeStorage[i].missingChild = node->missingChild;
+
+            for (const auto &child : node->children)
+            {
+                order.push_back(child.get());
+                FlatNode compiled;
+                if (!column.numeric)
+                    compiled.value = column.dictionary.find(child->value);
+                nodeStorage.push_back(compiled);
+            }
+
+            if (!column.numeric)
+                buildDispatch(nodeStorage[i], column.dictionary.size());
+        }
+
+        publish();
+    }
+
+    // Child of an internal node that rows without a value descend to
+    uint32_t missingBranch(const FlatNode &node) const
+    {
+        return node.missingChild != noChild ? node.firstChild + node.missingChild : noChild;
+    }
+
+    // Index of the child of an internal node that a row descends to, or
+    // noChild. The row supplies the encoded value of the node's feature
+    // through code() or number(); a row that cannot supply it, or supplies
+    // NaN, takes the node's missing branch. A categorical value with no
+    // branch at the node explicitly gets noChild.
+    template <typename Row>
+    uint32_t descend(const FlatNode &node, const Row &row) const
+    {
+        if (node.numeric)
+        {
+            double value;
+            if (!row.number(node.feature, value) || std::isnan(value))
+                return missingBranch(node);
+            return node.firstChild + (value <= node.threshold ? 0 : 1);
+        }
+
+        Code value;
+        if (!row.code(node.feature, value))
+            return missingBranch(node);
+
+        uint32_t slot = node.seed != 0 ? (value * node.seed) >> node.shift : value;
+        if (slot >= node.tableSize)
+            return noChild;
+
+        uint32_t entry = dispatch[node.table + slot];
+        if (entry == 0)
+            return noChild;
+
+        // A hashed slot may belong to a different code
+        uint32_t child = node.firstChild + entry - 1;
+        return nodes[child].value == value ? child : noChild;
+    }
+
+    // Leaf reached by one row, or noChild
+    template <typename Row>
+    uint32_t findLeaf(const Row &row) const
+    {
+        if (nodes.empty())
+            return noChild;
+
+        uint32_t index = 0;
+        while (index != noChild && nodes[index].feature >= 0)
+        {
+            index = descend(nodes[index], row);
+        }
+        return index;
+    }
+
+    // Predicted class code at a leaf, or unknown for noChild
+    Code leafPrediction(uint32_t leaf) const { return leaf != noChild ? nodes[leaf].prediction : unknown; }
+
+    // Predicted class code for one row, or unknown
+    template <typename Row>
+    Code predict(const Row &row) const
+    {
+        return leafPrediction(findLeaf(row));
+    }
+
+    // Class probabilities at a leaf, or nullptr if it has none
+    const float *leafProbabilities(uint32_t leaf) const
+    {
+        if (leaf == noChild || nodes[leaf].distribution == noChild)
+            return nullptr;
+        return &probabilities[nodes[leaf].distribution];
+    }
+
+    // Leaves reached by rows [begin, end) of a block, noChild where the walk
+    // ends early; out[0] receives row begin's. Rows are walked in groups that advance one level at a time,
+    // so the node loads of different rows overlap instead of each waiting on
+    // the previous one.
+    template <typename Block>
+    void findLeaves(const Block &block, size_t begin, size_t end, uint32_t *out) const
+    {
+        const size_t lanes = 8;
+        const uint32_t finished = noChild;
+
+        for (size_t base = begin; base < end; base += lanes)
+        {
+            size_t count = std::min(lanes, end - base);
+            uint32_t current[lanes];
+            std::fill_n(current, count, nodes.empty() ? finished : 0);
+            if (nodes.empty())
+                std::fill_n(out + (base - begin), count, finished);
+
+            size_t active = nodes.empty() ? 0 : count;
+            while (active > 0)
+            {
+                for (size_t lane = 0; lane < count; lane++)
+                {
+                    if (current[lane] == finished)
+                        continue;
+
+                    const FlatNode &node = nodes[current[lane]];
+                    uint32_t next = node.feature < 0 ? finished : descend(node, block.row(base + lane));
+                    if (next == finished)
+                    {
+                        out[base - begin + lane] = node.feature < 0 ? current[lane] : finished;
+                        active--;
+                    }
+#if defined(__GNUC__) || defined(__clang__)
+                    else
+                    {
+                        __builtin_prefetch(&nodes[next]);
+                    }
+#endif
+                    current[lane] = next;
+                }
+            }
+        }
+    }
+};
+
+static const uint32_t modelVersion = 2;
+
+// Accuracy and log-loss of a model over the rows it has scored
+struct Evaluation
+{
+    size_t rows;
+    size_t correct;
+    size_t unknown; // rows the model had no answer for
+    double logLoss; // summed over the rows
+
+    Evaluation() : rows(0), correct(0), unknown(0), logLoss(0.0) {}
+
+    // Score one row from its class probabilities; the most probable class,
+    // the first on ties, is the prediction
+    template <typename T>
+    void add(const T *probabilities, size_t classCount, Code actual)
+    {
+        Code predicted = static_cast<Code>(std::max_element(probabilities, probabilities + classCount) - probabilities);
+        rows++;
+        correct += predicted == actual;
+        logLoss -= std::log(std::max(static_cast<double>(probabilities[actual]), 1e-15));
+    }
+
+    // Score a row the model had no answer for: wrong, at the log-loss of a
+    // uniform guess
+    void addUnknown(size_t classCount)
+    {
+        rows++;
+        unknown++;
+        logLoss += std::log(static_cast<double>(classCount));
+    }
+
+    double accuracy() const { return rows > 0 ? static_cast<double>(correct) / rows : 0.0; }
+    double meanLogLoss() const { return rows > 0 ? logLoss / rows : 0.0; }
+};
+
+// Per column of schema, whether a node of any of the trees splits on it
+std::vector<char> splitColumns(const Dataset &schema, const FlatTree *trees, size_t count)
+{
+    std::vector<char> used(schema.columnCount(), 0);
+    for (size_t t = 0; t < count; t++)
+    {
+        for (size_t i = 0; i < trees[t].nodes.size(); i++)
+        {
+            if (trees[t].nodes[i].feature >= 0)
+                used[trees[t].nodes[i].feature] = 1;
+        }
+    }
+    return used;
+}
+
+// The helpers below are shared by the tree, the forest and the boosted
+// model, which differ only in how they combine their trees
+
+// Columns a model file keeps: the target and those the trees split on
+std::vector<char> modelColumns(const Dataset &schema, int targetId, const FlatTree *trees, size_t count)
+{
+    std::vector<char> used = splitColumns(schema, trees, count);
+    used[targetId] = 1;
+    return used;
+}
+
+// Report a model file that cannot be used; kind names its model, as in
+// "forest model"
+void reportModelFileError(BinaryStatus status, const std::string &filename, const char *kind)
+{
+    if (status == binaryMissing)
+        std::cerr << "Error: Cannot open file " << filename << std::endl;
+    else if (status == binaryForeign)
+        std::cerr << "Error: " << filename << " is not a " << kind << " file" << std::endl;
+    else if (status == binaryIncompatible)
+        std::cerr << "Error: Model file " << filename << " was written by an incompatible build" << std::endl;
+    else
+        std::cerr << "Error: Model file " << filename << " is damaged" << std::endl;
+}
+
+// Every row index of a dataset of count rows, to train on all of them
+std::vector<int> allRows(size_t count)
+{
+    std::vector<int> rows(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        rows[i] = i;
+    }
+    return rows;
+}
+
+// Name of a predicted class code of the target
+std::string className(const Dataset &schema, int targetId, Code prediction)
+{
+    if (prediction == FlatTree::unknown)
+        return "Unknown";
+    return std::string(schema.column(targetId).dictionary.value(prediction));
+}
+
+// Summary of the training data printed before the model
+void printDataInfo(const Dataset &data, int targetId)
+{
+    std::cout << "Dataset Information:" << std::endl;
+    std::cout << "===================" << std::endl;
+    std::cout << "Rows: " << data.rowCount() << std::endl;
+    std::cout << "Columns: " << data.columnCount() << std::endl;
+    std::cout << "Features: ";
+    for (size_t i = 0; i < data.columnCount(); i++)
+    {
+        std::cout << data.column(i).name << " ";
+    }
+    std::cout << std::endl;
+    std::cout << "Target: " << data.column(targetId).name << std::endl
+              << std::endl;
+}
+
+// Stream a CSV file through a model in blocks without keeping it in memory.
+// Only the fields of the columns flagged in used, those the model splits
+// on, are tokenized and encoded; the rest are stepped over.
+// scoreBlock(block, predictions, probabilities) fills in, per row of an
+// encoded block, the predicted class code and the class probabilities, or
+// FlatTree::unknown and nullptr. Writes one line per record with the
+// predicted class and the probability of each class; both are left empty
+// for Unknown.
+template <typename ScoreBlock>
+bool scoreCSVFile(const std::string &filename, std::ostream &out, const Dataset &schema, int targetId,
+                  const std::vector<char> &used, ScoreBlock scoreBlock)
+{
+    const size_t blockRows = 65536;
+
+    CsvReader reader;
+    EncodedBlock block;
+    if (!openEncodedCSV(reader, filename, schema, used, block))
+        return false;
+
+    const Column &target = schema.column(targetId);
+    std::vector<std::string> classNames(target.dictionary.size());
+    std::string buffer = "prediction";
+    for (Code c = 0; c < classNames.size(); c++)
+    {
+        classNames[c] = formatCsvField(target.dictionary.value(c));
+        buffer += "," + formatCsvField("probability_" + std::string(target.dictionary.value(c)));
+    }
+    buffer += '\n';
+
+    std::vector<Code> predictions;
+    std::vector<const float *> probabilities;
+    bool more = true;
+    while (more)
+    {
+        more = readEncodedBlock(reader, block, blockRows);
+
+        predictions.assign(block.rowCount(), FlatTree::unknown);
+        probabilities.assign(block.rowCount(), nullptr);
+        scoreBlock(block, predictions, probabilities);
+        for (size_t i = 0; i < block.rowCount(); i++)
+        {
+            if (predictions[i] != FlatTree::unknown)
+                buffer += classNames[predictions[i]];
+            for (size_t c = 0; c < classNames.size(); c++)
+            {
+                buffer += ',';
+                if (probabilities[i])
+                {
+                    char number[32];
+                    std::to_chars_result result = std::to_chars(number, number + sizeof(number), probabilities[i][c]);
+                    buffer.append(number, result.ptr);
+                }
+            }
+            buffer += '\n';
+        }
+
+        out.write(buffer.data(), buffer.size());
+        buffer.clear();
+    }
+
+    out.flush();
+    if (!out)
+    {
+        std::cerr << "Error: Failed to write predictions" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Grows one tree over a sample of a dataset's rows. The dataset is only
+// read, so any number of builders can share one; each keeps its own row
+// orders and partitions them in place as the tree grows.
+class TreeBuilder
+{
+private:
+    // Nodes smaller than this evaluate their candidates serially
+    static const int parallelSplitRows = 1024;
+    // Subtrees smaller than this are built by the thread that split them
+    static const int parallelSubtreeRows = 2048;
+
+    const Dataset &data;
+    int targetId; // column index of the target
+    std::vector<int> excluded; // columns never split on
+    TreeParams params;
+    size_t featuresPerSplit; // candidates drawn per node
+    ThreadPool *pool; // builds large subtrees and scores features in parallel when set
+    std::vector<int> rows;       // sampled row indices, partitioned in place per node
+    std::vector<int> scratch;    // staging area for partitionRows
+    std::vector<int> childOf;    // per row, the child the current split sends it to
+
+    // Every numeric feature keeps its own copy of the row indices in value
+    // order. They are partitioned alongside rows, so each node's rows stay in
+    // sorted order within [begin, end) and nothing is ever re-sorted.
+    std::vector<int> presortSlot;            // per column, index into presorted or -1
+    std::vector<std::vector<int>> presorted; // per numeric feature
+
+    // In histogram mode numeric splits are found from per-node (bin x class)
+    // histograms instead of the presorted orders. A node's histogram holds
+    // one block per numeric feature; a child's is either counted from its
+    // rows or, for the largest child, what is left of the parent's once all
+    // of its siblings have been subtracted.
+    bool histogramSplits;
+    std::vector<int> histogramOffset; // per column, offset of its block or -1
+    size_t histogramSize;
+
+    // Calculate information gain, with joined receiving the value whose
+    // branch takes the missing rows
+    double calculateInformationGain(RowSpan indices, int feature, Code &joined)
+    {
+        SplitStatistics &stats = threadStatistics();
+        const Column &column = data.column(feature);
+        stats.tally(column, data.column(targetId), indices);
+        return stats.informationGain(column.missingCode(), params.minSamplesLeaf, joined);
+    }
+
+    // Count rows[begin, end) into a fresh node histogram
+    void buildHistogram(int begin, int end, std::vector<int> &histogram)
+    {
+        histogram.assign(histogramSize, 0);
+
+        const Code *classes = data.column(targetId).codes.data();
+        size_t classCount = data.column(targetId).dictionary.size();
+        for (size_t i = 0; i < data.columnCount(); i++)
+        {
+            if (histogramOffset[i] < 0)
+                continue;
+
+            const uint8_t *bins = data.column(i).bins.data();
+            int *block = histogram.data() + histogramOffset[i];
+            for (int j = begin; j < end; j++)
+            {
+                int row = rows[j];
+                block[bins[row] * classCount + classes[row]]++;
+            }
+        }
+    }
+
+    // Score one candidate feature for rows[begin, end). Numeric features
+    // only qualify when their best threshold improves purity.
+    SplitCandidate evaluateFeature(int feature, int begin, int end, const std::vector<int> &histogram)
+    {
+        SplitCandidate candidate;
+        const Column &column = data.column(feature);
+
+        if (!column.numeric)
+        {
+            Code joined;
+            double gain = calculateInformationGain({rows.data() + begin, rows.data() + end}, feature, joined);
+            if (gain >= 0.0)
+            {
+                candidate.feature = feature;
+                candidate.gain = gain;
+                candidate.joined = joined;
+            }
+            return candidate;
+        }
+
+        SplitStatistics &stats = threadStatistics();
+        const Column &target = data.column(targetId);
+        double threshold = 0.0;
+        bool missingLeft = false;
+        double gain;
+        if (histogramSplits)
+        {
+            gain = stats.bestBinnedThreshold(column, target, &histogram[histogramOffset[feature]], params.minSamplesLeaf,
+                                             threshold, missingLeft);
+        }
+        else
+        {
+            const std::vector<int> &order = presorted[presortSlot[feature]];
+            gain = stats.bestThreshold(column, target, {order.data() + begin, order.data() + end}, params.minSamplesLeaf,
+                                       threshold, missingLeft);
+        }
+
+        if (gain > 0.0)
+        {
+            candidate.feature = feature;
+            candidate.gain = gain;
+            candidate.threshold = threshold;
+            candidate.missingLeft = missingLeft;
+        }
+        return candidate;
+    }
+
+    // Best split among candidates[0, count) for rows[begin, end). Large
+    // nodes spread the candidates over the thread pool.
+    SplitCandidate evaluateCandidates(const int *candidates, size_t count, int begin, int end,
+                                      const std::vector<int> &histogram)
+    {
+        std::vector<SplitCandidate> results(count);
+        auto evaluate = [&](size_t i)
+        {
+            results[i] = evaluateFeature(candidates[i], begin, end, histogram);
+        };
+
+        if (pool && end - begin >= parallelSplitRows)
+        {
+            pool->parallelFor(count, evaluate);
+        }
+        else
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                evaluate(i);
+            }
+        }
+
+        // Reduce in column order so ties resolve exactly as in a serial scan
+        SplitCandidate best;
+        for (const SplitCandidate &result : results)
+        {
+            if (result.feature >= 0 && result.gain > best.gain)
+                best = result;
+        }
+
+        return best;
+    }
+
+    // Find best split for rows[begin, end). Used categorical features are
+    // skipped; numeric features stay available. When the parameters limit
+    // the features per split, seed draws that many of them, and the others
+    // are only searched if none of the drawn ones can split the node.
+    SplitCandidate findBestFeature(int begin, int end, const FeatureMask &usedFeatures, const std::vector<int> &histogram,
+                                   uint64_t seed)
+    {
+        std::vector<int> candidates;
+        usedFeatures.forEachUnset([&](int feature)
+        {
+            candidates.push_back(feature);
+        });
+
+        if (featuresPerSplit >= candidates.size())
+            return evaluateCandidates(candidates.data(), candidates.size(), begin, end, histogram);
+
+        SplitMix random(seed);
+        for (size_t i = 0; i < featuresPerSplit; i++)
+        {
+            std::swap(candidates[i], candidates[i + random.below(candidates.size() - i)]);
+        }
+        std::sort(candidates.begin(), candidates.begin() + featuresPerSplit);
+        std::sort(candidates.begin() + featuresPerSplit, candidates.end());
+
+        SplitCandidate best = evaluateCandidates(candidates.data(), featuresPerSplit, begin, end, histogram);
+        if (best.feature < 0)
+            best = evaluateCandidates(candidates.data() + featuresPerSplit, candidates.size() - featuresPerSplit, begin, end,
+                                      histogram);
+        return best;
+    }
+
+    // Get most common class, filling counts with the rows per class
+    std::string getMostCommonClass(RowSpan indices, std::vector<int> &counts)
+    {
+        const Column &target = data.column(targetId);
+        counts.assign(target.dictionary.size(), 0);
+
+        for (int idx : indices)
+        {
+            counts[target.codes[idx]]++;
+        }
+
+        Code mostCommon = static_cast<Code>(std::max_element(counts.begin(), counts.end()) - counts.begin());
+        return std::string(target.dictionary.value(mostCommon));
+    }
+
+    // Check if all instances have same class
+    bool allSameClass(RowSpan indices)
+    {
+        if (indices.empty())
+            return true;
+
+        const std::vector<Code> &target = data.column(targetId).codes;
+        Code firstClass = target[indices[0]];
+
+        for (int idx : indices)
+        {
+            if (target[idx] != firstClass)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // Send each row of [begin, end) to the child for its categorical value,
+    // and the rows missing it to the child for joined. Children are ordered
+    // by code; values receives each child's code, childEnds the end offset
+    // of its range and node the missing branch and its missing rows.
+    void routeByValue(int begin, int end, const Column &column, Code joined, std::vector<Code> &values,
+                      std::vector<int> &childEnds, TreeNode &node)
+    {
+        // Subtrees may be built concurrently, so the counters are per thread
+        thread_local std::vector<int> groupSlots;
+        const Code *codes = column.codes.data();
+        if (groupSlots.size() < column.dictionary.size())
+            groupSlots.resize(column.dictionary.size(), 0);
+
+        Code missing = column.missingCode();
+        values.clear();
+        for (int i = begin; i < end; i++)
+        {
+            Code value = codes[rows[i]];
+            if (groupSlots[value]++ == 0 && value != missing)
+                values.push_back(value);
+        }
+        std::sort(values.begin(), values.end());
+
+        node.missingRows = 0;
+        if (missing != Dictionary::npos)
+        {
+            node.missingRows = groupSlots[missing];
+            groupSlots[joined] += node.missingRows;
+        }
+
+        // Replace each value's count by its child index
+        childEnds.clear();
+        int offset = begin;
+        for (size_t child = 0; child < values.size(); child++)
+        {
+            offset += groupSlots[values[child]];
+            groupSlots[values[child]] = child;
+            childEnds.push_back(offset);
+        }
+        node.missingChild = groupSlots[joined];
+        if (missing != Dictionary::npos)
+            groupSlots[missing] = node.missingChild;
+
+        for (int i = begin; i < end; i++)
+        {
+            childOf[rows[i]] = groupSlots[codes[rows[i]]];
+        }
+
+        for (Code value : values)
+        {
+            groupSlots[value] = 0;
+        }
+        if (missing != Dictionary::npos)
+            groupSlots[missing] = 0;
+    }
+
+    // Send each row of [begin, end) left when its value is <= threshold, and
+    // the rows missing it left too when missingLeft is set
+    void routeByThreshold(int begin, int end, const Column &column, double threshold, bool missingLeft,
+                          std::vector<int> &childEnds, TreeNode &node)
+    {
+        const double *numbers = column.numbers.data();
+        int leftCount = 0;
+        int missingCount = 0;
+
+        for (int i = begin; i < end; i++)
+        {
+            double value = numbers[rows[i]];
+            bool missing = std::isnan(value);
+            bool left = missing ? missingLeft : value <= threshold;
+            childOf[rows[i]] = left ? 0 : 1;
+            leftCount += left;
+            missingCount += missing;
+        }
+
+        childEnds.assign({begin + leftCount, end});
+        node.missingChild = missingLeft ? 0 : 1;
+        node.missingRows = missingCount;
+    }
+
+    // Stable partition of order[begin, end) into the routed children's ranges
+    void scatterRows(std::vector<int> &order, int begin, const std::vector<int> &childEnds)
+    {
+        std::vector<int> cursors(childEnds.size());
+        cursors[0] = begin;
+        for (size_t child = 1; child < childEnds.size(); child++)
+        {
+            cursors[child] = childEnds[child - 1];
+        }
+
+        int end = childEnds.back();
+        for (int i = begin; i < end; i++)
+        {
+            int row = order[i];
+            scratch[cursors[childOf[row]]++] = row;
+        }
+        std::copy(scratch.begin() + begin, scratch.begin() + end, order.begin() + begin);
+    }
+
+    // Move every row of [begin, end) into its child's contiguous range, in
+    // rows and in each presorted order
+    void partitionRows(int begin, const std::vector<int> &childEnds)
+    {
+        scatterRows(rows, begin, childEnds);
+        for (std::vector<int> &order : presorted)
+        {
+            scatterRows(order, begin, childEnds);
+        }
+    }
+
+    // Format a split threshold for display
+    static std::string formatNumber(double value)
+    {
+        std::ostringstream out;
+        out << value;
+        return out.str();
+    }
+
+    // Build decision tree recursively over rows[begin, end). In histogram mode
+    // histogram holds the node's counts; otherwise it is empty. seed drives
+    // the node's feature draw and, derived per child, those below it.
+    std::unique_ptr<TreeNode> buildTree(int begin, int end, FeatureMask usedFeatures, std::vector<int> histogram, int depth,
+                                        uint64_t seed)
+    {
+        auto node = std::make_unique<TreeNode>();
+        RowSpan indices = {rows.data() + begin, rows.data() + end};
+
+        // Base cases
+        if (indices.empty())
+        {
+            node->isLeaf = true;
+            node->prediction = "Unknown";
+            return node;
+        }
+
+        if (allSameClass(indices))
+        {
+            node->isLeaf = true;
+            const Column &target = data.column(targetId);
+            Code only = target.codes[indices[0]];
+            node->prediction = std::string(target.dictionary.value(only));
+            node->classCounts.assign(target.dictionary.size(), 0);
+            node->classCounts[only] = indices.size();
+            return node;
+        }
+
+        // Find best feature, unless the node is already as deep or as small
+        // as the parameters allow
+        SplitCandidate split;
+        bool splittable = (params.maxDepth == 0 || depth < params.maxDepth) && end - begin >= params.minSamplesSplit;
+        if (splittable)
+            split = findBestFeature(begin, end, usedFeatures, histogram, seed);
+        if (split.feature < 0)
+        {
+            node->isLeaf = true;
+            node->prediction = getMostCommonClass(indices, node->classCounts);
+            return node;
+        }
+
+        node->feature = split.feature;
+        const Column &column = data.column(split.feature);
+
+        // Route rows to children and label the branches
+        std::vector<int> childEnds;
+        std::vector<std::string> labels;
+        if (column.numeric)
+        {
+            node->threshold = split.threshold;
+            routeByThreshold(begin, end, column, split.threshold, split.missingLeft, childEnds, *node);
+            labels.push_back("<= " + formatNumber(split.threshold));
+            labels.push_back("> " + formatNumber(split.threshold));
+        }
+        else
+        {
+            usedFeatures.set(split.feature);
+            std::vector<Code> values;
+            routeByValue(begin, end, column, split.joined, values, childEnds, *node);
+            for (Code value : values)
+            {
+                labels.push_back(std::string(column.dictionary.value(value)));
+            }
+        }
+        partitionRows(begin, childEnds);
+
+        std::vector<int> childBegins(childEnds.size());
+        size_t largest = 0;
+        for (size_t i = 0; i < childEnds.size(); i++)
+        {
+            childBegins[i] = i == 0 ? begin : childEnds[i - 1];
+            if (childEnds[i] - childBegins[i] > childEnds[largest] - childBegins[largest])
+                largest = i;
+        }
+
+        // Each child only touches its own range of the shared arrays, so large
+        // subtrees are handed to the pool and the rest are built right here
+        node->children.resize(childEnds.size());
+        TaskGroup subtrees(pool);
+        auto buildChild = [&](size_t i, std::vector<int> childHistogram)
+        {
+            auto child = buildTree(childBegins[i], childEnds[i], usedFeatures, std::move(childHistogram), depth + 1,
+                                   SplitMix::derive(seed, i));
+            child->value = labels[i];
+            node->children[i] = std::move(child);
+        };
+        auto scheduleChild = [&](size_t i, std::vector<int> childHistogram)
+        {
+            if (pool && childEnds[i] - childBegins[i] >= parallelSubtreeRows)
+            {
+                auto shared = std::make_shared<std::vector<int>>(std::move(childHistogram));
+                subtrees.run([&buildChild, i, shared]
+                {
+                    buildChild(i, std::move(*shared));
+                });
+            }
+            else
+            {
+                buildChild(i, std::move(childHistogram));
+            }
+        };
+
+        // The largest child goes last so that in histogram mode it can
+        // inherit what remains of this node's histogram
+        for (size_t i = 0; i < childEnds.size(); i++)
+        {
+            if (i == largest)
+                continue;
+
+            std::vector<int> childHistogram;
+            if (histogramSplits)
+            {
+                buildHistogram(childBegins[i], childEnds[i], childHistogram);
+                for (size_t j = 0; j < histogramSize; j++)
+                {
+                    histogram[j] -= childHistogram[j];
+                }
+            }
+            scheduleChild(i, std::move(childHistogram));
+        }
+        scheduleChild(largest, std::move(histogram));
+
+        subtrees.wait();
+
+        return node;
+    }
+
+public:
+    TreeBuilder(const Dataset &data, int targetId, const std::vector<int> &excluded, const TreeParams &params,
+                ThreadPool *pool, bool histogramSplits)
+        : data(data), targetId(targetId), excluded(excluded), params(params),
+          featuresPerSplit(params.featuresPerSplit(data.columnCount() - 1 - excluded.size())), pool(pool),
+          histogramSplits(histogramSplits), histogramSize(0)
+    {
+    }
+
+    // Grow a tree over sample, a list of row indices in which rows may
+    // repeat, as in a bootstrap sample
+    std::unique_ptr<TreeNode> build(RowSpan sample, uint64_t seed)
+    {
+        rows.assign(sample.begin(), sample.end());
+        scratch.resize(rows.size());
+        childOf.resize(data.rowCount());
+
+        // A row appears in each numeric feature's order as often as in the
+        // sample, so the orders follow from the dataset-wide ones in linear
+        // time
+        std::vector<int> multiplicity(data.rowCount(), 0);
+        for (int row : rows)
+        {
+            multiplicity[row]++;
+        }
+
+        // The target and the excluded columns are never candidates, so they
+        // start out marked as used
+        FeatureMask usedFeatures(data.columnCount());
+        usedFeatures.set(targetId);
+        for (int column : excluded)
+        {
+            usedFeatures.set(column);
+        }
+
+        // Start each numeric feature from its value order, or lay out its
+        // block of the node histograms
+        size_t classCount = data.column(targetId).dictionary.size();
+        presortSlot.assign(data.columnCount(), -1);
+        presorted.clear();
+        histogramOffset.assign(data.columnCount(), -1);
+        histogramSize = 0;
+        for (size_t i = 0; i < data.columnCount(); i++)
+        {
+            const Column &column = data.column(i);
+            if (usedFeatures.test(i) || !column.numeric)
+                continue;
+
+            if (histogramSplits)
+            {
+                histogramOffset[i] = histogramSize;
+                histogramSize += column.binCount() * classCount;
+            }
+            else
+            {
+                presortSlot[i] = presorted.size();
+                presorted.emplace_back();
+                std::vector<int> &order = presorted.back();
+                order.reserve(rows.size());
+                for (int row : column.sortedRows)
+                {
+                    order.insert(order.end(), multiplicity[row], row);
+                }
+            }
+        }
+
+        std::vector<int> histogram;
+        if (histogramSplits)
+        {
+            buildHistogram(0, rows.size(), histogram);
+        }
+
+        return buildTree(0, rows.size(), usedFeatures, std::move(histogram), 0, seed);
+    }
+};
+
+// How a model is trained, whatever its kind
+struct TrainingOptions
+{
+    ThreadPool *pool;     // trains and scores in parallel when set
+    uint64_t seed;        // of every random draw; results do not depend on the pool
+    bool histogramSplits; // find numeric splits from binned histograms; boosting always does
+    bool datasetCache;    // load training data through Dataset::loadCached
+
+    TrainingOptions() : pool(nullptr), seed(0), histogramSplits(false), datasetCache(true) {}
+};
+
+// Load the training data for a target, through the dataset cache or straight
+// from the CSV, and resolve the target's column index. A non-empty feature
+// list restricts the load to those columns and the target.
+bool loadTrainingData(Dataset &data, const std::string &filename, const std::string &target,
+                      const std::vector<std::string> &features, const TrainingOptions &training, int &targetId)
+{
+    std::vector<std::string> selection = features;
+    if (!selection.empty())
+        selection.push_back(target);
+
+    bool loaded = training.datasetCache ? data.loadCached(filename, target, training.pool, selection)
+                                        : data.loadCSV(filename, target, training.pool, selection);
+    if (!loaded)
+    {
+        return false;
+    }
+
+    if (data.rowCount() == 0)
+    {
+        std::cerr << "Error: No data loaded" << std::endl;
+        return false;
+    }
+
+    // Resolve column names to indices once; the builder only uses indices
+    targetId = data.columnIndex(target);
+    if (targetId == -1)
+    {
+        std::cerr << "Error: Target column '" << target << "' not found" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+class DecisionTree
+{
+private:
+    Dataset owned;       // the data when trained from a file or loaded from a model
+    const Dataset *data; // owned, or the dataset shared through fit
+    std::string targetColumn;
+    int targetId; // column index of the target
+    std::unique_ptr<TreeNode> root;
+    FlatTree flat; // what predictions walk, compiled from root after training
+    MappedFile modelFile; // backs flat after loadModel
+    TrainingOptions training; // the seed drives the feature draws when params limits them
+    TreeParams params;
+
+    // Print tree recursively
+    void printTree(const TreeNode *node, int depth = 0, const std::string &parentCondition = "")
+    {
+        if (!node)
+            return;
+
+        std::string indent(depth * 2, ' ');
+
+        if (node->isLeaf)
+        {
+            std::cout << indent << "-> " << node->prediction << std::endl;
+        }
+        else
+        {
+            const Column &column = data->column(node->feature);
+            if (depth > 0)
+            {
+                std::cout << indent << "if " << column.name << " " << parentCondition << ":" << std::endl;
+            }
+            else
+            {
+                std::cout << "Root: " << column.name << std::endl;
+            }
+
+            // Children are kept in dictionary code order; categorical ones
+            // are printed in value order
+            std::vector<size_t> printOrder(node->children.size());
+            for (size_t i = 0; i < printOrder.size(); i++)
+            {
+                printOrder[i] = i;
+            }
+            if (!column.numeric)
+            {
+                std::sort(printOrder.begin(), printOrder.end(), [&](size_t a, size_t b)
+                {
+                    return node->children[a]->value < node->children[b]->value;
+                });
+            }
+
+            for (size_t i : printOrder)
+            {
+                const auto &child = node->children[i];
+
+                // Numeric branches are labelled with their comparison already
+                std::string condition = column.numeric ? child->value : "== " + child->value;
+                if (static_cast<int>(i) == node->missingChild && node->missingRows > 0)
+                    condition += " or missing";
+                if (node->feature >= 0)
+                {
+                    std::cout << indent << "  " << column.name << " " << condition << ":" << std::endl;
+                }
+                printTree(child.get(), depth + 1, condition);
+            }
+        }
+    }
+
+public:
+    DecisionTree() : data(&owned), targetId(-1) {}
+
+    // Pool, seed, split search and data loading of the next training
+    void setTrainingOptions(const TrainingOptions &options)
+    {
+        training = options;
+    }
+
+    // Limit the growth of the tree
+    void setParams(const TreeParams &treeParams)
+    {
+        params = treeParams;
+    }
+
+    // Train on a CSV file. A non-empty feature list restricts the tree to
+    // those columns, and only they and the target are loaded.
+    bool train(const std::string &filename, const std::string &target,
+               const std::vector<std::string> &features = std::vector<std::string>())
+    {
+        targetColumn = target;
+        if (!loadTrainingData(owned, filename, targetColumn, features, training, targetId))
+            return false;
+
+        std::vector<int> rows = allRows(owned.rowCount());
+        return fit(owned, targetId, RowSpan{rows.data(), rows.data() + rows.size()}, std::vector<int>());
+    }
+
+    // Train on some rows of a loaded dataset, which must outlive the tree.
+    // Excluded columns are never split on.
+    bool fit(const Dataset &dataset, int target, RowSpan rows, const std::vector<int> &excluded)
+    {
+        data = &dataset;
+        targetId = target;
+        targetColumn = dataset.column(target).name;
+
+        TreeBuilder builder(dataset, targetId, excluded, params, training.pool, training.histogramSplits);
+        root = builder.build(rows, training.seed);
+        flat.compile(root.get(), dataset, targetId);
+        modelFile.close();
+
+        return true;
+    }
+
+    // Accuracy and log-loss over rows of the dataset the tree was fit on
+    Evaluation evaluate(RowSpan rows) const
+    {
+        size_t classCount = data->column(targetId).dictionary.size();
+        const std::vector<Code> &actual = data->column(targetId).codes;
+        TableBlock table(*data, rows.first);
+        std::vector<uint32_t> leaves(rows.size());
+        flat.findLeaves(table, 0, rows.size(), leaves.data());
+
+        Evaluation result;
+        for (size_t i = 0; i < rows.size(); i++)
+        {
+            const float *probabilities = flat.leafProbabilities(leaves[i]);
+            if (probabilities)
+                result.add(probabilities, classCount, actual[rows[i]]);
+            else
+                result.addUnknown(classCount);
+        }
+        return result;
+    }
+
+    void printModel()
+    {
+        if (root)
+        {
+            std::cout << "\nDecision Tree Structure:" << std::endl;
+            std::cout << "========================" << std::endl;
+            printTree(root.get());
+        }
+        else
+        {
+            std::cout << "No tree built yet." << std::endl;
+        }
+    }
+
+    // Save the schema and the flat tree so loadModel can predict without the
+    // training data
+    bool saveModel(const std::string &filename) const
+    {
+        if (targetId < 0)
+        {
+            std::cerr << "Error: No model to save" << std::endl;
+            return false;
+        }
+
+        // Predictions only look up the target and the columns the tree tests
+        BinaryWriter payload;
+        data->writeSchema(payload, modelColumns(*data, targetId, &flat, 1));
+        payload.put<uint64_t>(targetId);
+        flat.write(payload);
+
+        if (!writeBinaryFile(filename, "DTMODEL", modelVersion, sizeof(FlatNode), payload))
+        {
+            std::cerr << "Error: Cannot write model file " << filename << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Map a model file written by saveModel and predict straight from the
+    // mapping. Only the dictionaries are copied; the nodes are used in place.
+    // On failure the tree is left empty.
+    bool loadModel(const std::string &filename)
+    {
+        root.reset();
+        flat = FlatTree();
+        owned = Dataset();
+        data = &owned;
+        targetId = -1;
+        targetColumn.clear();
+
+        BinaryReader in;
+        BinaryStatus status = mapBinaryFile(modelFile, filename, "DTMODEL", modelVersion, sizeof(FlatNode), in);
+        if (status != binaryOk)
+        {
+            reportModelFileError(status, filename, "model");
+            modelFile.close();
+            return false;
+        }
+
+        uint64_t target;
+        bool valid = owned.readSchema(in) && in.get(target) && target < data->columnCount() &&
+                     !data->column(target).numeric &&
+                     flat.read(in, *data, data->column(target).dictionary.size()) && in.atEnd();
+        if (!valid)
+        {
+            reportModelFileError(binaryDamaged, filename, "model");
+            flat = FlatTree();
+            owned = Dataset();
+            modelFile.close();
+            return false;
+        }
+
+        targetId = target;
+        targetColumn = data->column(targetId).name;
+        return true;
+    }
+
+    // Encode the columns the tree tests of a whole CSV file for
+    // predictBatch, as scoreCSV does block by block
+    bool encodeCSV(const std::string &filename, EncodedBlock &block)
+    {
+        CsvReader reader;
+        if (!openEncodedCSV(reader, filename, *data, splitColumns(*data, &flat, 1), block))
+            return false;
+
+        readEncodedBlock(reader, block, std::numeric_limits<size_t>::max());
+        return true;
+    }
+
+    // Leaf of every row of an encoded block, FlatTree::noChild where the tree
+    // has no answer. Large blocks are split across the pool.
+    std::vector<uint32_t> findLeaves(const EncodedBlock &block)
+    {
+        const size_t chunkRows = 4096;
+        std::vector<uint32_t> leaves(block.rowCount());
+        size_t chunks = (block.rowCount() + chunkRows - 1) / chunkRows;
+
+        auto walkChunk = [&](size_t chunk)
+        {
+            size_t begin = chunk * chunkRows;
+            size_t end = std::min(begin + chunkRows, block.rowCount());
+            flat.findLeaves(block, begin, end, leaves.data() + begin);
+        };
+
+        if (training.pool && chunks > 1)
+        {
+            training.pool->parallelFor(chunks, walkChunk);
+        }
+        else
+        {
+            for (size_t chunk = 0; chunk < chunks; chunk++)
+            {
+                walkChunk(chunk);
+            }
+        }
+
+        return leaves;
+    }
+
+    // Predicted class code of every row of an encoded block, FlatTree::unknown
+    // where the tree has no answer. probabilities, if given, receives each
+    // row's class probabilities, or nullptr for Unknown.
+    std::vector<Code> predictBatch(const EncodedBlock &block, std::vector<const float *> *probabilities = nullptr)
+    {
+        std::vector<uint32_t> leaves = findLeaves(block);
+        std::vector<Code> predictions(leaves.size());
+        if (probabilities)
+            probabilities->resize(leaves.size());
+        for (size_t i = 0; i < leaves.size(); i++)
+        {
+            predictions[i] = flat.leafPrediction(leaves[i]);
+            if (probabilities)
+                (*probabilities)[i] = flat.leafProbabilities(leaves[i]);
+        }
+        return predictions;
+    }
+
+    // Stream a CSV file through the tree; see scoreCSVFile
+    bool scoreCSV(const std::string &filename, std::ostream &out)
+    {
+        return scoreCSVFile(filename, out, *data, targetId, splitColumns(*data, &flat, 1),
+                            [&](const EncodedBlock &block, std::vector<Code> &predictions,
+                                std::vector<const float *> &probabilities)
+        {
+            predictions = predictBatch(block, &probabilities);
+        });
+    }
+
+    // Name of a predicted class code
+    std::string className(Code prediction) const
+    {
+        return ::className(*data, targetId, prediction);
+    }
+
+    std::string predictInstance(const std::map<std::string, std::string> &instance)
+    {
+        return className(flat.predict(InstanceRow{*data, instance}));
+    }
+
+    void printDataInfo()
+    {
+        ::printDataInfo(*data, targetId);
+    }
+};
+
+// Random forest (Breiman, 2001) of trees grown by TreeBuilder on one shared
+// dataset. Every tree sees its own bootstrap sample of the rows and draws
+// the candidates of each split from a random subset of the features; the
+// forest predicts the class with the highest mean leaf probability.
+class RandomForest
+{
+private:
+    // Rows per chunk when a block is spread over the pool
+    static const size_t chunkRows = 4096;
+
+    Dataset owned;       // the data when trained from a file or loaded from a model
+    const Dataset *data; // owned, or the dataset shared through fit
+    std::string targetColumn;
+    int targetId; // column index of the target
+    std::vector<FlatTree> trees;
+    MappedFile modelFile; // backs trees after loadModel
+    TrainingOptions training; // the seed drives the bootstrap samples and feature draws
+    TreeParams params;
+    size_t treeCount;
+    bool outOfBag; // estimate accuracy and log-loss from the rows each tree did not see
+
+    // Out-of-bag votes. Probabilities are summed in 32.32 fixed point so the
+    // totals do not depend on the order in which trees finish.
+    std::vector<uint64_t> outOfBagSums; // classCount per row
+    std::vector<uint32_t> outOfBagVotes; // per row
+    std::mutex outOfBagMutex;
+
+    // Bootstrap sample of tree number index: as many rows as there are
+    // training rows, drawn with replacement from a stream of its own
+    std::vector<int> bootstrapSample(size_t index, RowSpan rows) const
+    {
+        SplitMix random(SplitMix::derive(training.seed, index));
+        std::vector<int> sample(rows.size());
+        for (int &row : sample)
+        {
+            row = rows[random.below(rows.size())];
+        }
+        std::sort(sample.begin(), sample.end());
+        return sample;
+    }
+
+    // Sum the leaf probabilities of every tree for rows [begin, end) of a
+    // block into sums (classCount per row) and count the trees that reached
+    // a leaf with probabilities into votes
+    template <typename Block>
+    void accumulate(const Block &block, size_t begin, size_t end, float *sums, uint32_t *votes) const
+    {
+        size_t classCount = data->column(targetId).dictionary.size();
+        std::vector<uint32_t> leaves(end - begin);
+        for (const FlatTree &tree : trees)
+        {
+            tree.findLeaves(block, begin, end, leaves.data());
+            for (size_t i = begin; i < end; i++)
+            {
+                const float *probabilities = tree.leafProbabilities(leaves[i - begin]);
+                if (!probabilities)
+                    continue;
+                votes[i]++;
+                for (size_t c = 0; c < classCount; c++)
+                {
+                    sums[i * classCount + c] += probabilities[c];
+                }
+            }
+        }
+    }
+
+    // Score the training rows a tree's sorted bootstrap sample left out and
+    // add its votes for them to the out-of-bag totals. The rows are found in
+    // one merge of the sample with sortedRows, the training rows in
+    // ascending order. Runs as soon as the tree is compiled, while its nodes
+    // are still in cache.
+    void voteOutOfBag(const FlatTree &tree, const std::vector<int> &sample, const std::vector<int> &sortedRows)
+    {
+        std::vector<int> unused;
+        size_t next = 0;
+        for (int row : sortedRows)
+        {
+            while (next < sample.size() && sample[next] < row)
+                next++;
+            if (next == sample.size() || sample[next] != row)
+                unused.push_back(row);
+        }
+
+        TableBlock table(*data, unused.data());
+        std::vector<uint32_t> leaves(unused.size());
+        tree.findLeaves(table, 0, unused.size(), leaves.data());
+
+        size_t classCount = data->column(targetId).dictionary.size();
+        std::lock_guard<std::mutex> lock(outOfBagMutex);
+        for (size_t i = 0; i < unused.size(); i++)
+        {
+            const float *probabilities = tree.leafProbabilities(leaves[i]);
+            if (!probabilities)
+                continue;
+            outOfBagVotes[unused[i]]++;
+            for (size_t c = 0; c < classCount; c++)
+            {
+                outOfBagSums[unused[i] * classCount + c] += std::llround(std::ldexp(probabilities[c], 32));
+            }
+        }
+    }
+
+    // Turn summed probabilities into means and pick the most probable class,
+    // FlatTree::unknown where no tree answered
+    static Code vote(float *probabilities, size_t classCount, uint32_t votes)
+    {
+        if (votes == 0)
+            return FlatTree::unknown;
+
+        for (size_t c = 0; c < classCount; c++)
+        {
+            probabilities[c] /= votes;
+        }
+        return static_cast<Code>(std::max_element(probabilities, probabilities + classCount) - probabilities);
+    }
+
+public:
+    RandomForest()
+        : data(&owned), targetId(-1), treeCount(100), outOfBag(false)
+    {
+        params.maxFeatures = sqrtFeatures;
+    }
+
+    // Pool, seed, split search and data loading of the next training. The
+    // same seed grows the same forest whatever the number of threads.
+    void setTrainingOptions(const TrainingOptions &options)
+    {
+        training = options;
+    }
+
+    // Limit the growth of every tree; features per split default to sqrt
+    void setParams(const TreeParams &treeParams)
+    {
+        params = treeParams;
+    }
+
+    void setTreeCount(size_t count)
+    {
+        treeCount = count;
+    }
+
+    // Estimate accuracy and log-loss from out-of-bag rows while training
+    void setOutOfBag(bool enabled)
+    {
+        outOfBag = enabled;
+    }
+
+    // Train on a CSV file. A non-empty feature list restricts the forest to
+    // those columns, and only they and the target are loaded.
+    bool train(const std::string &filename, const std::string &target,
+               const std::vector<std::string> &features = std::vector<std::string>())
+    {
+        targetColumn = target;
+        if (!loadTrainingData(owned, filename, targetColumn, features, training, targetId))
+            return false;
+
+        std::vector<int> rows = allRows(owned.rowCount());
+        return fit(owned, targetId, RowSpan{rows.data(), rows.data() + rows.size()}, std::vector<int>());
+    }
+
+    // Train on some rows of a loaded dataset, which must outlive the
+    // forest. Excluded columns are never split on.
+    bool fit(const Dataset &dataset, int target, RowSpan rows, const std::vector<int> &excluded)
+    {
+        data = &dataset;
+        targetId = target;
+        targetColumn = dataset.column(target).name;
+
+        // Trees are grown side by side; each one's builder also hands its
+        // large subtrees to the pool, which keeps the threads busy while
+        // the last trees finish
+        trees.clear();
+        trees.resize(treeCount);
+        size_t classCount = data->column(targetId).dictionary.size();
+        std::vector<int> sortedRows;
+        if (outOfBag)
+        {
+            outOfBagSums.assign(data->rowCount() * classCount, 0);
+            outOfBagVotes.assign(data->rowCount(), 0);
+            sortedRows.assign(rows.begin(), rows.end());
+            std::sort(sortedRows.begin(), sortedRows.end());
+        }
+
+        auto growTree = [&](size_t index)
+        {
+            std::vector<int> sample = bootstrapSample(index, rows);
+            TreeBuilder builder(*data, targetId, excluded, params, training.pool, training.histogramSplits);
+            std::unique_ptr<TreeNode> root = builder.build(RowSpan{sample.data(), sample.data() + sample.size()},
+                                                           SplitMix::derive(~training.seed, index));
+            trees[index].compile(root.get(), *data, targetId);
+            if (outOfBag)
+                voteOutOfBag(trees[index], sample, sortedRows);
+        };
+
+        if (training.pool)
+        {
+            training.pool->parallelFor(treeCount, growTree);
+        }
+        else
+        {
+            for (size_t i = 0; i < treeCount; i++)
+            {
+                growTree(i);
+            }
+        }
+
+        // Rows that were in every tree's sample have no estimate
+        if (outOfBag)
+        {
+            Evaluation estimate;
+            std::vector<double> probabilities(classCount);
+            const std::vector<Code> &actual = data->column(targetId).codes;
+            for (int row : rows)
+            {
+                if (outOfBagVotes[row] == 0)
+                    continue;
+                for (size_t c = 0; c < classCount; c++)
+                {
+                    probabilities[c] = std::ldexp(static_cast<double>(outOfBagSums[row * classCount + c]), -32) /
+                                       outOfBagVotes[row];
+                }
+                estimate.add(probabilities.data(), classCount, actual[row]);
+            }
+
+            std::cerr << "Out-of-bag estimate over " << estimate.rows << " rows: accuracy " << estimate.accuracy()
+                      << ", log-loss " << estimate.meanLogLoss() << std::endl;
+            outOfBagSums = std::vector<uint64_t>();
+            outOfBagVotes = std::vector<uint32_t>();
+        }
+
+        modelFile.close();
+        return true;
+    }
+
+    // Accuracy and log-loss over rows of the dataset the forest was fit on
+    Evaluation evaluate(RowSpan rows) const
+    {
+        size_t classCount = data->column(targetId).dictionary.size();
+        const std::vector<Code> &actual = data->column(targetId).codes;
+        TableBlock table(*data, rows.first);
+        std::vector<float> probabilities(rows.size() * classCount, 0.0f);
+        std::vector<uint32_t> votes(rows.size(), 0);
+        accumulate(table, 0, rows.size(), probabilities.data(), votes.data());
+
+        Evaluation result;
+        for (size_t i = 0; i < rows.size(); i++)
+        {
+            if (vote(&probabilities[i * classCount], classCount, votes[i]) != FlatTree::unknown)
+                result.add(&probabilities[i * classCount], classCount, actual[rows[i]]);
+            else
+                result.addUnknown(classCount);
+        }
+        return result;
+    }
+
+    void printModel()
+    {
+        if (trees.empty())
+        {
+            std::cout << "No forest built yet." << std::endl;
+            return;
+        }
+
+        size_t nodeCount = 0;
+        size_t leafCount = 0;
+        for (const FlatTree &tree : trees)
+        {
+            nodeCount += tree.nodes.size();
+            for (size_t i = 0; i < tree.nodes.size(); i++)
+            {
+                leafCount += tree.nodes[i].feature < 0;
+            }
+        }
+
+        std::cout << "\nRandom Forest:" << std::endl;
+        std::cout << "==============" << std::endl;
+        std::cout << "Trees: " << trees.size() << std::endl;
+        std::cout << "Nodes: " << nodeCount << " (" << leafCount << " leaves)" << std::endl;
+    }
+
+    // Save the schema and every flat tree so loadModel can predict without
+    // the training data
+    bool saveModel(const std::string &filename) const
+    {
+        if (targetId < 0)
+        {
+            std::cerr << "Error: No model to save" << std::endl;
+            return false;
+        }
+
+        BinaryWriter payload;
+        data->writeSchema(payload, modelColumns(*data, targetId, trees.data(), trees.size()));
+        payload.put<uint64_t>(targetId);
+        payload.put<uint64_t>(trees.size());
+        for (const FlatTree &tree : trees)
+        {
+            tree.write(payload);
+        }
+
+        if (!writeBinaryFile(filename, "DTFORST", modelVersion, sizeof(FlatNode), payload))
+        {
+            std::cerr << "Error: Cannot write model file " << filename << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Map a model file written by saveModel and predict straight from the
+    // mapping. On failure the forest is left empty.
+    bool loadModel(const std::string &filename)
+    {
+        trees.clear();
+        owned = Dataset();
+        data = &owned;
+        targetId = -1;
+        targetColumn.clear();
+
+        BinaryReader in;
+        BinaryStatus status = mapBinaryFile(modelFile, filename, "DTFORST", modelVersion, sizeof(FlatNode), in);
+        if (status != binaryOk)
+        {
+            reportModelFileError(status, filename, "forest model");
+            modelFile.close();
+            return false;
+        }
+
+        uint64_t target, count;
+        bool valid = owned.readSchema(in) && in.get(target) && target < data->columnCount() &&
+                     !data->column(target).numeric && in.get(count);
+        for (uint64_t i = 0; valid && i < count; i++)
+        {
+            trees.emplace_back();
+            valid = trees.back().read(in, *data, data->column(target).dictionary.size());
+        }
+        if (!valid || !in.atEnd())
+        {
+            reportModelFileError(binaryDamaged, filename, "forest model");
+            trees.clear();
+            owned = Dataset();
+            modelFile.close();
+            return false;
+        }
+
+        targetId = target;
+        targetColumn = data->column(targetId).name;
+        return true;
+    }
+
+    // Mean class probabilities (classCount per row) and the predicted class
+    // code of every row of an encoded block, FlatTree::unknown where no tree
+    // has an answer. Large blocks are split across the pool.
+    void predictProbabilities(const EncodedBlock &block, std::vector<float> &probabilities, std::vector<Code> &predictions)
+    {
+        size_t classCount = data->column(targetId).dictionary.size();
+        probabilities.assign(block.rowCount() * classCount, 0.0f);
+        predictions.assign(block.rowCount(), FlatTree::unknown);
+        std::vector<uint32_t> votes(block.rowCount(), 0);
+        size_t chunks = (block.rowCount() + chunkRows - 1) / chunkRows;
+
+        auto scoreChunk = [&](size_t chunk)
+        {
+            size_t begin = chunk * chunkRows;
+            size_t end = std::min(begin + chunkRows, block.rowCount());
+            accumulate(block, begin, end, probabilities.data(), votes.data());
+            for (size_t i = begin; i < end; i++)
+            {
+                predictions[i] = vote(&probabilities[i * classCount], classCount, votes[i]);
+            }
+        };
+
+        if (training.pool && chunks > 1)
+        {
+            training.pool->parallelFor(chunks, scoreChunk);
+        }
+        else
+        {
+            for (size_t chunk = 0; chunk < chunks; chunk++)
+            {
+                scoreChunk(chunk);
+            }
+        }
+    }
+
+    // Stream a CSV file through the forest; see scoreCSVFile
+    bool scoreCSV(const std::string &filename, std::ostream &out)
+    {
+        size_t classCount = data->column(targetId).dictionary.size();
+        std::vector<float> means;
+        std::vector<Code> votes;
+        return scoreCSVFile(filename, out, *data, targetId, splitColumns(*data, trees.data(), trees.size()),
+                            [&](const EncodedBlock &block, std::vector<Code> &predictions,
+                                std::vector<const float *> &probabilities)
+        {
+            predictProbabilities(block, means, votes);
+            for (size_t i = 0; i < block.rowCount(); i++)
+            {
+                predictions[i] = votes[i];
+                if (votes[i] != FlatTree::unknown)
+                    probabilities[i] = &means[i * classCount];
+            }
+        });
+    }
+
+    // Name of a predicted class code
+    std::string className(Code prediction) const
+    {
+        return ::className(*data, targetId, prediction);
+    }
+
+    std::string predictInstance(const std::map<std::string, std::string> &instance)
+    {
+        size_t classCount = data->column(targetId).dictionary.size();
+        std::vector<float> sums(classCount, 0.0f);
+        uint32_t votes = 0;
+        InstanceRow row{*data, instance};
+        for (const FlatTree &tree : trees)
+        {
+            const float *probabilities = tree.leafProbabilities(tree.findLeaf(row));
+            if (!probabilities)
+                continue;
+            votes++;
+            for (size_t c = 0; c < classCount; c++)
+            {
+                sums[c] += probabilities[c];
+            }
+        }
+        return className(vote(sums.data(), classCount, votes));
+    }
+
+    void printDataInfo()
+    {
+        ::printDataInfo(*data, targetId);
+    }
+};
+
+// Settings of a gradient boosting run, named and defaulted as in XGBoost
+struct BoostParams
+{
+    size_t rounds;          // trees, one per boosting round
+    double learningRate;    // shrinkage applied to every leaf output (eta)
+    int maxDepth;           // 0 for no limit
+    double subsample;       // fraction of the rows each tree is grown on
+    double colsampleByTree; // fraction of the features each tree may split on
+    double gamma;           // loss reduction a split must achieve
+    double lambda;          // L2 penalty on leaf outputs
+    double minChildWeight;  // hessian sum each child needs at least
+
+    BoostParams()
+        : rounds(100), learningRate(0.3), maxDepth(6), subsample(1.0), colsampleByTree(1.0), gamma(0.0), lambda(1.0),
+          minChildWeight(1.0) {}
+};
+
+// Gradient boosted trees for a two-class target, minimizing log-loss with
+// second-order (Newton) steps as XGBoost does. Trees split the numeric
+// columns at their histogram bin edges: every node keeps a histogram of
+// gradient and hessian sums per bin, the larger child of a split gets its
+// histogram by subtracting the smaller one's from the parent's, and the
+// histograms of large nodes are filled on the thread pool, one feature per
+// task. Missing values take the branch that reduces the loss most. The
+// model predicts the second class of the target's dictionary with
+// probability sigmoid(bias + sum of the leaf outputs).
+class GradientBoosting
+{
+private:
+    // Nodes smaller than this fill their histograms serially
+    static const int parallelHistogramRows = 4096;
+    // Rows per chunk when rows are spread over the pool
+    static const size_t chunkRows = 4096;
+
+    struct GradientBin
+    {
+        double gradient;
+        double hessian;
+        int count;
+
+        GradientBin() : gradient(0.0), hessian(0.0), count(0) {}
+    };
+
+    struct BoostSplit
+    {
+        int feature; // -1 if no split reduces the loss
+        double gain;
+        double threshold;
+        bool missingLeft;
+
+        BoostSplit() : feature(-1), gain(0.0), threshold(0.0), missingLeft(false) {}
+    };
+
+    Dataset owned;       // the data when trained from a file or loaded from a model
+    const Dataset *data; // owned, or the dataset shared through fit
+    std::string targetColumn;
+    int targetId; // column index of the target
+    double bias;  // log-odds of the second class before the first tree
+    std::vector<FlatTree> trees;
+    MappedFile modelFile; // backs trees after loadModel
+    TrainingOptions training; // the seed drives the row and feature samples
+    BoostParams params;
+
+    // State of the tree being grown
+    std::vector<double> gradients;   // per row
+    std::vector<double> hessians;    // per row
+    std::vector<int> rows;           // sampled rows, partitioned in place per node
+    std::vector<int> scratch;        // staging area for the partition
+    std::vector<int> features;       // numeric columns the tree may split on
+    std::vector<size_t> binOffset;   // per entry of features, offset of its histogram block
+    size_t histogramSize;
+
+    static double sigmoid(double margin) { return 1.0 / (1.0 + std::exp(-margin)); }
+
+    // Loss reduction term G^2 / (H + lambda) of one side of a split
+    double score(double gradient, double hessian) const { return gradient * gradient / (hessian + params.lambda); }
+
+    // Run fn(begin, end) over [0, count) in chunks, across the pool if set
+    template <typename Fn>
+    void forChunks(size_t count, Fn fn)
+    {
+        size_t chunks = (count + chunkRows - 1) / chunkRows;
+        auto run = [&](size_t chunk)
+        {
+            fn(chunk * chunkRows, std::min(count, (chunk + 1) * chunkRows));
+        };
+
+        if (training.pool && chunks > 1)
+        {
+            training.pool->parallelFor(chunks, run);
+        }
+        else
+        {
+            for (size_t chunk = 0; chunk < chunks; chunk++)
+            {
+                run(chunk);
+            }
+        }
+    }
+
+    // Fill a fresh histogram from rows[begin, end), one feature per task
+    void buildHistogram(int begin, int end, std::vector<GradientBin> &histogram)
+    {
+        histogram.assign(histogramSize, GradientBin());
+
+        auto fill = [&](size_t k)
+        {
+            const uint8_t *bins = data->column(features[k]).bins.data();
+            GradientBin *block = histogram.data() + binOffset[k];
+            for (int i = begin; i < end; i++)
+            {
+                int row = rows[i];
+                GradientBin &bin = block[bins[row]];
+                bin.gradient += gradients[row];
+                bin.hessian += hessians[row];
+                bin.count++;
+            }
+        };
+
+        if (training.pool && end - begin >= parallelHistogramRows)
+        {
+            training.pool->parallelFor(features.size(), fill);
+        }
+        else
+        {
+            for (size_t k = 0; k < features.size(); k++)
+            {
+                fill(k);
+            }
+        }
+    }
+
+    // Best threshold of feature number k given its histogram block and the
+    // node's totals. Thresholds are bin edges; the missing bin is tried on
+    // both sides, and a tie keeps it right.
+    void bestSplit(size_t k, const GradientBin *block, const GradientBin &total, BoostSplit &best) const
+    {
+        const Column &column = data->column(features[k]);
+        const GradientBin &missing = block[column.missingBin()];
+        double parent = score(total.gradient, total.hessian);
+
+        GradientBin left;
+        for (size_t b = 0; b < column.binEdges.size(); b++)
+        {
+            if (block[b].count == 0)
+                continue;
+            left.gradient += block[b].gradient;
+            left.hessian += block[b].hessian;
+            left.count += block[b].count;
+            if (left.count + missing.count == total.count)
+                break;
+
+            for (int side = 0; side < (missing.count > 0 ? 2 : 1); side++)
+            {
+                double leftGradient = left.gradient + (side ? missing.gradient : 0.0);
+                double leftHessian = left.hessian + (side ? missing.hessian : 0.0);
+                double rightGradient = total.gradient - leftGradient;
+                double rightHessian = total.hessian - leftHessian;
+                if (leftHessian < params.minChildWeight || rightHessian < params.minChildWeight)
+                    continue;
+
+                double gain = 0.5 * (score(leftGradient, leftHessian) + score(rightGradient, rightHessian) - parent) -
+                              params.gamma;
+                if (gain > best.gain)
+                {
+                    best.feature = features[k];
+                    best.gain = gain;
+                    best.threshold = column.binEdges[b];
+                    best.missingLeft = side == 1;
+                }
+            }
+        }
+    }
+
+    // Grow a node over rows[begin, end) whose histogram is given
+    std::unique_ptr<TreeNode> grow(int begin, int end, int depth, std::vector<GradientBin> histogram)
+    {
+        auto node = std::make_unique<TreeNode>();
+
+        // Every feature's block sums to the node's totals
+        GradientBin total;
+        const Column &first = data->column(features[0]);
+        for (size_t b = 0; b < first.binCount(); b++)
+        {
+            total.gradient += histogram[b].gradient;
+            total.hessian += histogram[b].hessian;
+            total.count += histogram[b].count;
+        }
+
+        BoostSplit split;
+        if (params.maxDepth == 0 || depth < params.maxDepth)
+        {
+            for (size_t k = 0; k < features.size(); k++)
+            {
+                bestSplit(k, histogram.data() + binOffset[k], total, split);
+            }
+        }
+
+        if (split.feature < 0)
+        {
+            node->isLeaf = true;
+            double output = -total.gradient / (total.hessian + params.lambda) * params.learningRate;
+            node->scores.assign(1, static_cast<float>(output));
+            return node;
+        }
+
+        // Stable partition into left and right
+        const double *numbers = data->column(split.feature).numbers.data();
+        int left = begin;
+        int right = end;
+        for (int i = begin; i < end; i++)
+        {
+            double value = numbers[rows[i]];
+            bool missing = std::isnan(value);
+            node->missingRows += missing;
+            if (missing ? split.missingLeft : value <= split.threshold)
+                rows[left++] = rows[i];
+            else
+                scratch[--right] = rows[i];
+        }
+        std::reverse_copy(scratch.begin() + right, scratch.begin() + end, rows.begin() + left);
+
+        node->feature = split.feature;
+        node->threshold = split.threshold;
+        node->missingChild = split.missingLeft ? 0 : 1;
+
+        // Count the smaller child and derive the larger one by subtraction
+        bool leftSmaller = left - begin <= end - left;
+        std::vector<GradientBin> smaller;
+        if (leftSmaller)
+            buildHistogram(begin, left, smaller);
+        else
+            buildHistogram(left, end, smaller);
+        for (size_t j = 0; j < histogramSize; j++)
+        {
+            histogram[j].gradient -= smaller[j].gradient;
+            histogram[j].hessian -= smaller[j].hessian;
+            histogram[j].count -= smaller[j].count;
+        }
+
+        node->children.push_back(grow(begin, left, depth + 1, leftSmaller ? std::move(smaller) : std::move(histogram)));
+        node->children.push_back(grow(left, end, depth + 1, leftSmaller ? std::move(histogram) : std::move(smaller)));
+        return node;
+    }
+
+    // Add tree's output to the margins of the training rows
+    void updateMargins(const FlatTree &tree, RowSpan trainingRows, std::vector<double> &margins)
+    {
+        TableBlock table(*data, trainingRows.first);
+        forChunks(trainingRows.size(), [&](size_t begin, size_t end)
+        {
+            std::vector<uint32_t> leaves(end - begin);
+            tree.findLeaves(table, begin, end, leaves.data());
+            for (size_t i = begin; i < end; i++)
+            {
+                const float *output = tree.leafProbabilities(leaves[i - begin]);
+                if (output)
+                    margins[trainingRows[i]] += *output;
+            }
+        });
+    }
+
+    // Raw score of rows [begin, end) of a block, summed over all trees
+    template <typename Block>
+    void predictMargins(const Block &block, size_t begin, size_t end, double *margins) const
+    {
+        std::fill(margins + begin, margins + end, bias);
+        std::vector<uint32_t> leaves(end - begin);
+        for (const FlatTree &tree : trees)
+        {
+            tree.findLeaves(block, begin, end, leaves.data());
+            for (size_t i = begin; i < end; i++)
+            {
+                const float *output = tree.leafProbabilities(leaves[i - begin]);
+                if (output)
+                    margins[i] += *output;
+            }
+        }
+    }
+
+public:
+    GradientBoosting() : data(&owned), targetId(-1), bias(0.0), histogramSize(0) {}
+
+    // Pool, seed and data loading of the next training; histogramSplits is
+    // ignored, as boosting always splits on bins
+    void setTrainingOptions(const TrainingOptions &options)
+    {
+        training = options;
+    }
+
+    void setParams(const BoostParams &boostParams)
+    {
+        params = boostParams;
+    }
+
+    // Train on a CSV file whose target has exactly two classes. Only the
+    // numeric columns are split on; a non-empty feature list restricts them
+    // further, and only they and the target are loaded.
+    bool train(const std::string &filename, const std::string &target,
+               const std::vector<std::string> &featureNames = std::vector<std::string>())
+    {
+        targetColumn = target;
+        if (!loadTrainingData(owned, filename, targetColumn, featureNames, training, targetId))
+            return false;
+
+        std::vector<int> trainingRows = allRows(owned.rowCount());
+        return fit(owned, targetId, RowSpan{trainingRows.data(), trainingRows.data() + trainingRows.size()},
+                   std::vector<int>());
+    }
+
+    // Train on some rows of a loaded dataset, which must outlive the model.
+    // Excluded columns are never split on.
+    bool fit(const Dataset &dataset, int target, RowSpan trainingRows, const std::vector<int> &excluded)
+    {
+        data = &dataset;
+        targetId = target;
+        targetColumn = dataset.column(target).name;
+        trees.clear();
+
+        const Column &labels = data->column(targetId);
+        if (labels.dictionary.size() != 2)
+        {
+            std::cerr << "Error: Gradient boosting needs a target with two classes, '" << targetColumn << "' has "
+                      << labels.dictionary.size() << std::endl;
+            return false;
+        }
+
+        std::vector<int> numericColumns;
+        for (size_t i = 0; i < data->columnCount(); i++)
+        {
+            if (data->column(i).numeric && std::find(excluded.begin(), excluded.end(), i) == excluded.end())
+                numericColumns.push_back(i);
+        }
+        if (numericColumns.empty())
+        {
+            std::cerr << "Error: Gradient boosting needs at least one numeric feature" << std::endl;
+            return false;
+        }
+
+        // Start every row from the log-odds of the second class. Gradients
+        // and margins are indexed by dataset row but only kept up to date
+        // for the training rows.
+        size_t n = data->rowCount();
+        size_t positives = 0;
+        for (int row : trainingRows)
+        {
+            positives += labels.codes[row] == 1;
+        }
+        double rate = std::min(std::max(static_cast<double>(positives) / trainingRows.size(), 1e-6), 1.0 - 1e-6);
+        bias = std::log(rate / (1.0 - rate));
+
+        std::vector<double> margins(n, bias);
+        gradients.resize(n);
+        hessians.resize(n);
+        scratch.resize(n);
+        trees.resize(params.rounds);
+        size_t featureCount = std::max<size_t>(1, static_cast<size_t>(std::lround(params.colsampleByTree * numericColumns.size())));
+
+        for (size_t round = 0; round < params.rounds; round++)
+        {
+            // Log-loss gradient and hessian of every training row at the
+            // current margins
+            forChunks(trainingRows.size(), [&](size_t begin, size_t end)
+            {
+                for (size_t i = begin; i < end; i++)
+                {
+                    int row = trainingRows[i];
+                    double p = sigmoid(margins[row]);
+                    gradients[row] = p - (labels.codes[row] == 1 ? 1.0 : 0.0);
+                    hessians[row] = std::max(p * (1.0 - p), 1e-16);
+                }
+            });
+
+            SplitMix random(SplitMix::derive(training.seed, round));
+            rows.clear();
+            for (int row : trainingRows)
+            {
+                if (params.subsample >= 1.0 || (random.next() >> 11) * 0x1.0p-53 < params.subsample)
+                    rows.push_back(row);
+            }
+
+            features = numericColumns;
+            if (featureCount < features.size())
+            {
+                for (size_t i = 0; i < featureCount; i++)
+                {
+                    std::swap(features[i], features[i + random.below(features.size() - i)]);
+                }
+                features.resize(featureCount);
+                std::sort(features.begin(), features.end());
+            }
+
+            binOffset.clear();
+            histogramSize = 0;
+            for (int feature : features)
+            {
+                binOffset.push_back(histogramSize);
+                histogramSize += data->column(feature).binCount();
+            }
+
+            std::unique_ptr<TreeNode> root;
+            if (rows.empty())
+            {
+                root = std::make_unique<TreeNode>();
+                root->isLeaf = true;
+                root->scores.assign(1, 0.0f);
+            }
+            else
+            {
+                std::vector<GradientBin> histogram;
+                buildHistogram(0, rows.size(), histogram);
+                root = grow(0, rows.size(), 0, std::move(histogram));
+            }
+            trees[round].compile(root.get(), *data, targetId);
+            updateMargins(trees[round], trainingRows, margins);
+        }
+
+        rows = std::vector<int>();
+        scratch = std::vector<int>();
+        gradients = std::vector<double>();
+        hessians = std::vector<double>();
+        modelFile.close();
+        return true;
+    }
+
+    // Accuracy and log-loss over rows of the dataset the model was fit on
+    Evaluation evaluate(RowSpan rows) const
+    {
+        const std::vector<Code> &actual = data->column(targetId).codes;
+        TableBlock table(*data, rows.first);
+        std::vector<double> margins(rows.size());
+        predictMargins(table, 0, rows.size(), margins.data());
+
+        Evaluation result;
+        for (size_t i = 0; i < rows.size(); i++)
+        {
+            double p = sigmoid(margins[i]);
+            double probabilities[2] = {1.0 - p, p};
+            result.add(probabilities, 2, actual[rows[i]]);
+        }
+        return result;
+    }
+
+    void printModel()
+    {
+        if (trees.empty())
+        {
+            std::cout << "No model built yet." << std::endl;
+            return;
+        }
+
+        size_t nodeCount = 0;
+        size_t leafCount = 0;
+        for (const FlatTree &tree : trees)
+        {
+            nodeCount += tree.nodes.size();
+            for (size_t i = 0; i < tree.nodes.size(); i++)
+            {
+                leafCount += tree.nodes[i].feature < 0;
+            }
+        }
+
+        std::cout << "\nGradient Boosting:" << std::endl;
+        std::cout << "==================" << std::endl;
+        std::cout << "Trees: " << trees.size() << std::endl;
+        std::cout << "Nodes: " << nodeCount << " (" << leafCount << " leaves)" << std::endl;
+        std::cout << "Positive class: " << data->column(targetId).dictionary.value(1) << std::endl;
+    }
+
+    // Save the schema, the bias and every tree so loadModel can predict
+    // without the training data
+    bool saveModel(const std::string &filename) const
+    {
+        if (targetId < 0)
+        {
+            std::cerr << "Error: No model to save" << std::endl;
+            return false;
+        }
+
+        BinaryWriter payload;
+        data->writeSchema(payload, modelColumns(*data, targetId, trees.data(), trees.size()));
+        payload.put<uint64_t>(targetId);
+        payload.put<double>(bias);
+        payload.put<uint64_t>(trees.size());
+        for (const FlatTree &tree : trees)
+        {
+            tree.write(payload);
+        }
+
+        if (!writeBinaryFile(filename, "DTBOOST", modelVersion, sizeof(FlatNode), payload))
+        {
+            std::cerr << "Error: Cannot write model file " << filename << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Map a model file written by saveModel and predict straight from the
+    // mapping. On failure the model is left empty.
+    bool loadModel(const std::string &filename)
+    {
+        trees.clear();
+        owned = Dataset();
+        data = &owned;
+        targetId = -1;
+        targetColumn.clear();
+
+        BinaryReader in;
+        BinaryStatus status = mapBinaryFile(modelFile, filename, "DTBOOST", modelVersion, sizeof(FlatNode), in);
+        if (status != binaryOk)
+        {
+            reportModelFileError(status, filename, "boosted model");
+            modelFile.close();
+            return false;
+        }
+
+        // Leaves hold one output each
+        uint64_t target, count;
+        bool valid = owned.readSchema(in) && in.get(target) && target < data->columnCount() &&
+                     !data->column(target).numeric && data->column(target).dictionary.size() == 2 && in.get(bias) &&
+                     std::isfinite(bias) && in.get(count);
+        for (uint64_t i = 0; valid && i < count; i++)
+        {
+            trees.emplace_back();
+            valid = trees.back().read(in, *data, 1);
+        }
+        if (!valid || !in.atEnd())
+        {
+            reportModelFileError(binaryDamaged, filename, "boosted model");
+            trees.clear();
+            owned = Dataset();
+            modelFile.close();
+            return false;
+        }
+
+        targetId = target;
+        targetColumn = data->column(targetId).name;
+        return true;
+    }
+
+    // Probability of the second class for every row of an encoded block.
+    // Large blocks are split across the pool.
+    std::vector<double> predictProbabilities(const EncodedBlock &block)
+    {
+        std::vector<double> probabilities(block.rowCount());
+        forChunks(block.rowCount(), [&](size_t begin, size_t end)
+        {
+            predictMargins(block, begin, end, probabilities.data());
+            for (size_t i = begin; i < end; i++)
+            {
+                probabilities[i] = sigmoid(probabilities[i]);
+            }
+        });
+        return probabilities;
+    }
+
+    // Stream a CSV file through the model; see scoreCSVFile
+    bool scoreCSV(const std::string &filename, std::ostream &out)
+    {
+        std::vector<float> pairs;
+        return scoreCSVFile(filename, out, *data, targetId, splitColumns(*data, trees.data(), trees.size()),
+                            [&](const EncodedBlock &block, std::vector<Code> &predictions,
+                                std::vector<const float *> &probabilities)
+        {
+            std::vector<double> positive = predictProbabilities(block);
+            pairs.resize(2 * positive.size());
+            for (size_t i = 0; i < positive.size(); i++)
+            {
+                pairs[2 * i] = static_cast<float>(1.0 - positive[i]);
+                pairs[2 * i + 1] = static_cast<float>(positive[i]);
+                predictions[i] = positive[i] > 0.5 ? 1 : 0;
+                probabilities[i] = &pairs[2 * i];
+            }
+        });
+    }
+
+    std::string predictInstance(const std::map<std::string, std::string> &instance)
+    {
+        double margin = bias;
+        InstanceRow row{*data, instance};
+        for (const FlatTree &tree : trees)
+        {
+            const float *output = tree.leafProbabilities(tree.findLeaf(row));
+            if (output)
+                margin += *output;
+        }
+        return className(*data, targetId, sigmoid(margin) > 0.5 ? 1 : 0);
+    }
+
+    void printDataInfo()
+    {
+        ::printDataInfo(*data, targetId);
+    }
+};
+
+// Command line settings that apply to every kind of model
+struct Options
+{
+    std::string filename;
+    std::string targetColumn;
+    std::string scoreFile;
+    std::string outFile;
+    std::string modelFile;
+    std::string saveFile;
+    std::vector<std::string> features;
+};
+
+// Load or train a model as the options say, then save it, score a file with
+// it or predict interactively
+template <typename Model>
+int runModel(Model &model, Options options)
+{
+    if (!options.modelFile.empty() && !model.loadModel(options.modelFile))
+        return 1;
+
+    // Saving and batch scoring never touch stdin, so they can run in pipelines
+    if (!options.scoreFile.empty() || !options.saveFile.empty())
+    {
+        if (options.modelFile.empty())
+        {
+            if (options.filename.empty() || options.targetColumn.empty())
+            {
+                std::cerr << "Error: --score and --save require --model, or --train and --target" << std::endl;
+                return 1;
+            }
+            if (!model.train(options.filename, options.targetColumn, options.features))
+                return 1;
+        }
+
+        if (!options.saveFile.empty() && !model.saveModel(options.saveFile))
+            return 1;
+        if (options.scoreFile.empty())
+            return 0;
+
+        if (options.outFile.empty())
+            return model.scoreCSV(options.scoreFile, std::cout) ? 0 : 1;
+
+        std::ofstream out(options.outFile, std::ios::binary);
+        if (!out)
+        {
+            std::cerr << "Error: Cannot create file " << options.outFile << std::endl;
+            return 1;
+        }
+        return model.scoreCSV(options.scoreFile, out) ? 0 : 1;
+    }
+
+    std::cout << "Decision Tree Builder" << std::endl;
+    std::cout << "====================" << std::endl;
+
+    bool ready = !options.modelFile.empty();
+    if (ready)
+    {
+        std::cout << "Loaded model " << options.modelFile << std::endl;
+    }
+    else
+    {
+        if (options.filename.empty())
+        {
+            std::cout << "Enter CSV filename: ";
+            if (!std::getline(std::cin, options.filename))
+                return 1;
+        }
+
+        if (options.targetColumn.empty())
+        {
+            std::cout << "Enter target column name: ";
+            if (!std::getline(std::cin, options.targetColumn))
+                return 1;
+        }
+
+        ready = model.train(options.filename, options.targetColumn, options.features);
+        if (ready)
+        {
+            model.printDataInfo();
+            model.printModel();
+        }
+    }
+
+    if (ready)
+    {
+        // Interactive prediction
+        std::cout << "\nInteractive Prediction Mode" << std::endl;
+        std::cout << "===========================" << std::endl;
+        std::cout << "Enter 'quit' to exit" << std::endl;
+
+        std::string input;
+        while (true)
+        {
+            std::cout << "\nEnter feature values (format: feature1=value1,feature2=value2): ";
+            // End of input ends the session like quit
+            if (!std::getline(std::cin, input) || input == "quit")
+                break;
+
+            std::map<std::string, std::string> instance;
+            std::stringstream ss(input);
+            std::string pair;
+
+            while (std::getline(ss, pair, ','))
+            {
+                size_t pos = pair.find('=');
+                if (pos != std::string::npos)
+                {
+                    std::string feature = pair.substr(0, pos);
                     std::string value = pair.substr(pos + 1);
 
                     // Remove whitespace
@@ -461,7 +5000,7 @@ int main()
 
             if (!instance.empty())
             {
-                std::string prediction = tree.predictInstance(instance);
+                std::string prediction = model.predictInstance(instance);
                 std::cout << "Prediction: " << prediction << std::endl;
             }
             else
@@ -472,4 +5011,548 @@ int main()
     }
 
     return 0;
+}
+
+// Row indices in ascending order of a column, rows with equal values in file
+// order and missing values last. Categorical values compare as text, which
+// orders ISO dates (YYYY-MM-DD) correctly.
+std::vector<int> rowsInColumnOrder(const Column &column)
+{
+    if (column.numeric)
+        return column.sortedRows;
+
+    // Rank the distinct values once rather than comparing text per row
+    std::vector<Code> values(column.dictionary.size());
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        values[i] = i;
+    }
+    std::sort(values.begin(), values.end(), [&](Code a, Code b)
+    {
+        std::string_view left = column.dictionary.value(a);
+        std::string_view right = column.dictionary.value(b);
+        return !left.empty() && (right.empty() || left < right);
+    });
+    std::vector<size_t> rank(values.size());
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        rank[values[i]] = i;
+    }
+
+    std::vector<int> order(column.codes.size());
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b)
+    {
+        return rank[column.codes[a]] < rank[column.codes[b]];
+    });
+    return order;
+}
+
+// Walk-forward folds, as scikit-learn's TimeSeriesSplit, over one dataset.
+// Rows are ordered by the date column and the last splits * (n / (splits + 1))
+// of them cut into equal test blocks; each fold trains on every row before
+// its block, so no fold learns from the future. Folds are ranges of one
+// shared row order, and every model fit on them shares the dataset, with its
+// bins and presorted orders. The date column is never split on.
+//
+// Sharing the dataset lets a little of the future in: the histogram bin
+// edges of numeric columns are quantiles over every row, test folds
+// included, so models that split on bins (--histogram and boosting) place
+// their thresholds with some knowledge of later rows. Exact splits only use
+// training values, and dictionary codes of values first seen in a test
+// fold never get a branch, so they are unaffected.
+class TimeSeriesFolds
+{
+private:
+    Dataset data;
+    int targetId;
+    int dateId;
+    std::vector<int> order; // every row, in date order
+    size_t splits;
+    size_t testRows; // per fold
+
+public:
+    TimeSeriesFolds() : targetId(-1), dateId(-1), splits(0), testRows(0) {}
+
+    // Load the training data of options, with the date column even when a
+    // feature list leaves it out, and cut it into folds
+    bool load(const Options &options, size_t splitCount, const std::string &dateColumn, const TrainingOptions &training)
+    {
+        std::vector<std::string> features = options.features;
+        if (!features.empty() && std::find(features.begin(), features.end(), dateColumn) == features.end())
+            features.push_back(dateColumn);
+
+        if (!loadTrainingData(data, options.filename, options.targetColumn, features, training, targetId))
+            return false;
+
+        dateId = data.columnIndex(dateColumn);
+        if (dateId == -1 || dateId == targetId)
+        {
+            std::cerr << "Error: Date column '" << dateColumn << "' not found" << std::endl;
+            return false;
+        }
+
+        order = rowsInColumnOrder(data.column(dateId));
+        splits = splitCount;
+        testRows = order.size() / (splits + 1);
+        if (testRows == 0)
+        {
+            std::cerr << "Error: " << order.size() << " rows are too few for " << splits << " folds" << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+
+    size_t size() const { return splits; }
+
+    RowSpan training(size_t fold) const
+    {
+        return RowSpan{order.data(), order.data() + order.size() - (splits - fold) * testRows};
+    }
+
+    RowSpan test(size_t fold) const
+    {
+        const int *begin = training(fold).end();
+        return RowSpan{begin, begin + testRows};
+    }
+
+    // Fit model on a fold's training rows and score it on its test rows
+    template <typename Model>
+    bool run(Model &model, size_t fold, Evaluation &result) const
+    {
+        if (!model.fit(data, targetId, training(fold), std::vector<int>(1, dateId)))
+            return false;
+        result = model.evaluate(test(fold));
+        return true;
+    }
+};
+
+// Cross-validate the model configure(model) sets up on walk-forward folds,
+// training and scoring them side by side
+template <typename Model, typename Configure>
+int crossValidate(const Options &options, size_t splits, const std::string &dateColumn,
+                  const TrainingOptions &training, Configure configure)
+{
+    if (options.filename.empty() || options.targetColumn.empty())
+    {
+        std::cerr << "Error: --cv requires --train and --target" << std::endl;
+        return 1;
+    }
+
+    TimeSeriesFolds folds;
+    if (!folds.load(options, splits, dateColumn, training))
+        return 1;
+
+    std::vector<Evaluation> results(splits);
+    std::vector<char> fitted(splits, 0);
+    auto runFold = [&](size_t fold)
+    {
+        Model model;
+        configure(model);
+        fitted[fold] = folds.run(model, fold, results[fold]);
+    };
+
+    if (training.pool)
+    {
+        training.pool->parallelFor(splits, runFold);
+    }
+    else
+    {
+        for (size_t fold = 0; fold < splits; fold++)
+        {
+            runFold(fold);
+        }
+    }
+
+    double accuracy = 0.0;
+    double logLoss = 0.0;
+    for (size_t fold = 0; fold < splits; fold++)
+    {
+        if (!fitted[fold])
+            return 1;
+
+        std::cout << "Fold " << fold + 1 << ": train " << folds.training(fold).size() << " rows, test "
+                  << folds.test(fold).size() << " rows, accuracy " << results[fold].accuracy() << ", log-loss "
+                  << results[fold].meanLogLoss() << ", unknown " << results[fold].unknown << std::endl;
+        accuracy += results[fold].accuracy();
+        logLoss += results[fold].meanLogLoss();
+    }
+    std::cout << "Mean over " << splits << " folds: accuracy " << accuracy / splits << ", log-loss "
+              << logLoss / splits << std::endl;
+
+    return 0;
+}
+
+// Randomized search over the tree limits, as scikit-learn's
+// RandomizedSearchCV with the notebooks' distributions: max_depth in
+// [5, 19], min_samples_leaf and min_samples_split in [2, 9] and max_features
+// sqrt, log2 or all. Every (configuration x fold) pair is one job on the
+// pool, all over one loaded dataset. A configuration's leaderboard line,
+// with its mean accuracy and log-loss over the folds, is written to out as
+// soon as its last fold is scored; the best configuration by accuracy is
+// reported on standard error at the end.
+template <typename Model, typename Configure>
+int searchParams(const Options &options, size_t iterations, size_t splits, const std::string &dateColumn,
+                 const TrainingOptions &training, std::ostream &out, Configure configure)
+{
+    if (options.filename.empty() || options.targetColumn.empty())
+    {
+        std::cerr << "Error: --search requires --train and --target" << std::endl;
+        return 1;
+    }
+
+    TimeSeriesFolds folds;
+    if (!folds.load(options, splits, dateColumn, training))
+        return 1;
+
+    const FeatureSubset subsets[] = {sqrtFeatures, log2Features, allFeatures};
+    std::vector<TreeParams> candidates(iterations);
+    SplitMix random(training.seed);
+    for (TreeParams &candidate : candidates)
+    {
+        candidate.maxDepth = 5 + random.below(15);
+        candidate.minSamplesLeaf = 2 + random.below(8);
+        candidate.minSamplesSplit = 2 + random.below(8);
+        candidate.maxFeatures = subsets[random.below(3)];
+    }
+
+    out << "iteration,max_depth,min_samples_split,min_samples_leaf,max_features,accuracy,log_loss\n" << std::flush;
+
+    // Jobs run a configuration's folds largest first, so that its line is
+    // not held back by one long fit at the end
+    std::vector<Evaluation> results(iterations * splits);
+    std::vector<size_t> foldsLeft(iterations, splits);
+    std::vector<char> fitted(iterations * splits, 0);
+    std::vector<double> accuracy(iterations, 0.0); // mean over the folds
+    std::vector<double> logLoss(iterations, 0.0);
+    std::mutex outMutex;
+    auto runJob = [&](size_t job)
+    {
+        size_t iteration = job / splits;
+        size_t fold = splits - 1 - job % splits;
+        Model model;
+        configure(model);
+        model.setParams(candidates[iteration]);
+        fitted[job] = folds.run(model, fold, results[job]);
+
+        std::lock_guard<std::mutex> lock(outMutex);
+        if (--foldsLeft[iteration] > 0)
+            return;
+
+        for (size_t i = iteration * splits; i < (iteration + 1) * splits; i++)
+        {
+            accuracy[iteration] += results[i].accuracy() / splits;
+            logLoss[iteration] += results[i].meanLogLoss() / splits;
+        }
+
+        const TreeParams &candidate = candidates[iteration];
+        out << iteration + 1 << "," << candidate.maxDepth << "," << candidate.minSamplesSplit << ","
+            << candidate.minSamplesLeaf << "," << featureSubsetName(candidate.maxFeatures) << ","
+            << accuracy[iteration] << "," << logLoss[iteration] << "\n" << std::flush;
+    };
+
+    if (training.pool)
+    {
+        training.pool->parallelFor(results.size(), runJob);
+    }
+    else
+    {
+        for (size_t job = 0; job < results.size(); job++)
+        {
+            runJob(job);
+        }
+    }
+
+    if (std::find(fitted.begin(), fitted.end(), 0) != fitted.end())
+        return 1;
+
+    // Ties on accuracy go to the lower log-loss, then the earlier draw
+    size_t best = 0;
+    for (size_t i = 1; i < iterations; i++)
+    {
+        if (accuracy[i] > accuracy[best] || (accuracy[i] == accuracy[best] && logLoss[i] < logLoss[best]))
+            best = i;
+    }
+
+    const TreeParams &winner = candidates[best];
+    std::cerr << "Best of " << iterations << " configurations: iteration " << best + 1 << ", max_depth "
+              << winner.maxDepth << ", min_samples_split " << winner.minSamplesSplit << ", min_samples_leaf "
+              << winner.minSamplesLeaf << ", max_features " << featureSubsetName(winner.maxFeatures)
+              << "; accuracy " << accuracy[best] << ", log-loss " << logLoss[best] << std::endl;
+
+    return out ? 0 : 1;
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    TreeParams params;
+    BoostParams boostParams;
+    bool maxFeaturesSet = false;
+    bool maxDepthSet = false;
+    size_t forestTrees = 0;
+    bool outOfBag = false;
+    size_t boostRounds = 0;
+    size_t cvSplits = 0;
+    size_t searchIterations = 0;
+    std::string dateColumn = "Date";
+    TrainingOptions training;
+    std::unique_ptr<ThreadPool> pool;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string option = argv[i];
+        if (option == "--histogram")
+        {
+            training.histogramSplits = true;
+        }
+        else if (option == "--no-cache")
+        {
+            training.datasetCache = false;
+        }
+        else if (option == "--threads" && i + 1 < argc)
+        {
+            // 0 uses every hardware thread
+            size_t threads = std::strtoul(argv[++i], nullptr, 10);
+            if (threads == 0)
+                threads = std::max(1u, std::thread::hardware_concurrency());
+            pool = std::make_unique<ThreadPool>(threads);
+            training.pool = pool.get();
+        }
+        else if (option == "--train" && i + 1 < argc)
+        {
+            options.filename = argv[++i];
+        }
+        else if (option == "--target" && i + 1 < argc)
+        {
+            options.targetColumn = argv[++i];
+        }
+        else if (option == "--features" && i + 1 < argc)
+        {
+            // Comma-separated column names
+            std::stringstream list(argv[++i]);
+            std::string feature;
+            while (std::getline(list, feature, ','))
+            {
+                if (!feature.empty())
+                    options.features.push_back(feature);
+            }
+        }
+        else if (option == "--score" && i + 1 < argc)
+        {
+            options.scoreFile = argv[++i];
+        }
+        else if (option == "--out" && i + 1 < argc)
+        {
+            options.outFile = argv[++i];
+        }
+        else if (option == "--model" && i + 1 < argc)
+        {
+            options.modelFile = argv[++i];
+        }
+        else if (option == "--save" && i + 1 < argc)
+        {
+            options.saveFile = argv[++i];
+        }
+        else if (option == "--forest" && i + 1 < argc)
+        {
+            // Number of trees; the model is a random forest instead of one tree
+            forestTrees = std::strtoul(argv[++i], nullptr, 10);
+            if (forestTrees == 0)
+            {
+                std::cerr << "Error: --forest needs at least one tree" << std::endl;
+                return 1;
+            }
+        }
+        else if (option == "--oob")
+        {
+            outOfBag = true;
+        }
+        else if (option == "--boost" && i + 1 < argc)
+        {
+            // Number of rounds; the model is gradient boosted trees instead
+            boostRounds = std::strtoul(argv[++i], nullptr, 10);
+            if (boostRounds == 0)
+            {
+                std::cerr << "Error: --boost needs at least one round" << std::endl;
+                return 1;
+            }
+        }
+        else if (option == "--learning-rate" && i + 1 < argc)
+        {
+            boostParams.learningRate = std::atof(argv[++i]);
+        }
+        else if (option == "--subsample" && i + 1 < argc)
+        {
+            boostParams.subsample = std::atof(argv[++i]);
+        }
+        else if (option == "--colsample-bytree" && i + 1 < argc)
+        {
+            boostParams.colsampleByTree = std::atof(argv[++i]);
+        }
+        else if (option == "--gamma" && i + 1 < argc)
+        {
+            boostParams.gamma = std::atof(argv[++i]);
+        }
+        else if (option == "--max-depth" && i + 1 < argc)
+        {
+            params.maxDepth = std::max(0, std::atoi(argv[++i]));
+            maxDepthSet = true;
+        }
+        else if (option == "--min-samples-split" && i + 1 < argc)
+        {
+            params.minSamplesSplit = std::max(2, std::atoi(argv[++i]));
+        }
+        else if (option == "--min-samples-leaf" && i + 1 < argc)
+        {
+            params.minSamplesLeaf = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (option == "--max-features" && i + 1 < argc)
+        {
+            std::string subset = argv[++i];
+            if (subset == "sqrt")
+                params.maxFeatures = sqrtFeatures;
+            else if (subset == "log2")
+                params.maxFeatures = log2Features;
+            else if (subset == "all")
+                params.maxFeatures = allFeatures;
+            else
+            {
+                std::cerr << "Error: --max-features must be sqrt, log2 or all" << std::endl;
+                return 1;
+            }
+            maxFeaturesSet = true;
+        }
+        else if (option == "--seed" && i + 1 < argc)
+        {
+            training.seed = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if (option == "--cv" && i + 1 < argc)
+        {
+            // Number of walk-forward folds; reports their scores instead of
+            // training one model
+            cvSplits = std::strtoul(argv[++i], nullptr, 10);
+            if (cvSplits == 0)
+            {
+                std::cerr << "Error: --cv needs at least one fold" << std::endl;
+                return 1;
+            }
+        }
+        else if (option == "--date-column" && i + 1 < argc)
+        {
+            dateColumn = argv[++i];
+        }
+        else if (option == "--search" && i + 1 < argc)
+        {
+            // Number of random configurations of the tree limits to cross-validate
+            searchIterations = std::strtoul(argv[++i], nullptr, 10);
+            if (searchIterations == 0)
+            {
+                std::cerr << "Error: --search needs at least one configuration" << std::endl;
+                return 1;
+            }
+        }
+        else
+        {
+            std::cerr << "Unknown option: " << option << std::endl;
+            return 1;
+        }
+    }
+
+    if ((cvSplits > 0 || searchIterations > 0) && !options.modelFile.empty())
+    {
+        std::cerr << "Error: --cv and --search train their own models and cannot be used with --model" << std::endl;
+        return 1;
+    }
+    if (outOfBag && (forestTrees == 0 || boostRounds > 0 || !options.modelFile.empty()))
+    {
+        std::cerr << "Error: --oob scores a forest while it is trained and needs --forest, without --boost or --model"
+                  << std::endl;
+        return 1;
+    }
+    if (searchIterations > 0 && boostRounds > 0)
+    {
+        std::cerr << "Error: --search tunes the tree limits of a tree or forest and cannot be used with --boost"
+                  << std::endl;
+        return 1;
+    }
+
+    // The leaderboard of a search goes to --out, or standard output
+    std::ofstream leaderboardFile;
+    if (searchIterations > 0 && !options.outFile.empty())
+    {
+        leaderboardFile.open(options.outFile, std::ios::binary);
+        if (!leaderboardFile)
+        {
+            std::cerr << "Error: Cannot create file " << options.outFile << std::endl;
+            return 1;
+        }
+    }
+    std::ostream &leaderboard = leaderboardFile.is_open() ? leaderboardFile : std::cout;
+    size_t searchSplits = cvSplits > 0 ? cvSplits : 5;
+
+    // Saved ensembles are loaded as such without being asked to
+    std::string modelKind = options.modelFile.empty() ? std::string() : binaryFileKind(options.modelFile);
+    if (boostRounds > 0 || modelKind == "DTBOOST")
+    {
+        // Boosted trees are depth 6 unless told otherwise, as in XGBoost
+        boostParams.rounds = boostRounds;
+        if (maxDepthSet)
+            boostParams.maxDepth = params.maxDepth;
+
+        auto configure = [&](GradientBoosting &boosting)
+        {
+            boosting.setTrainingOptions(training);
+            boosting.setParams(boostParams);
+        };
+        if (cvSplits > 0)
+            return crossValidate<GradientBoosting>(options, cvSplits, dateColumn, training, configure);
+
+        GradientBoosting boosting;
+        configure(boosting);
+        return runModel(boosting, options);
+    }
+
+    if (forestTrees > 0 || modelKind == "DTFORST")
+    {
+        // Forests draw sqrt(features) candidates per split unless told otherwise
+        if (!maxFeaturesSet)
+            params.maxFeatures = sqrtFeatures;
+
+        auto configure = [&](RandomForest &forest)
+        {
+            forest.setTrainingOptions(training);
+            forest.setParams(params);
+            forest.setTreeCount(forestTrees);
+            forest.setOutOfBag(outOfBag);
+        };
+        if (searchIterations > 0)
+            return searchParams<RandomForest>(options, searchIterations, searchSplits, dateColumn, training,
+                                              leaderboard, configure);
+        if (cvSplits > 0)
+            return crossValidate<RandomForest>(options, cvSplits, dateColumn, training, configure);
+
+        RandomForest forest;
+        configure(forest);
+        return runModel(forest, options);
+    }
+
+    auto configure = [&](DecisionTree &tree)
+    {
+        tree.setTrainingOptions(training);
+        tree.setParams(params);
+    };
+    if (searchIterations > 0)
+        return searchParams<DecisionTree>(options, searchIterations, searchSplits, dateColumn, training, leaderboard,
+                                          configure);
+    if (cvSplits > 0)
+        return crossValidate<DecisionTree>(options, cvSplits, dateColumn, training, configure);
+
+    DecisionTree tree;
+    configure(tree);
+    return runModel(tree, options);
 }
\ No newline at end of file